@@ -0,0 +1,150 @@
+/*
+    VFC Event Log
+
+    With `events 1` in vfc.cnf the node appends an event to .vfc/events.log
+    for every transaction it commits, along with the balances the transaction
+    left the two addresses at. The log is only ever appended to, `vfc clean`,
+    `trunc` or a quick scan rewriting blocks.dat shows up as a REWIND event
+    rather than as moved offsets.
+
+    Events are fixed size and numbered from zero, event n is at byte
+    EVENTS_HEAD + n*sizeof(struct vfc_event). A consumer keeps the number of
+    the next event it wants, maps the log read-only and reads the events in
+    place. The count in the header is published after an event is written,
+    the events below it are complete.
+
+    EVENT_COMMIT - a transaction was appended, height is the chain height after it
+    EVENT_BASE - the log (re)starts at height, the records below it are only in blocks.dat
+    EVENT_REWIND - blocks.dat was cut back to height, the commits after it are void
+
+    Balances exclude the subG value of minted addresses, it depends on the
+    network difficulty and is added by `vfc <address>`.
+
+    eventsOpen() - Map the log read-only
+    eventsCount() - Events written so far
+    eventsAt() - Event n, NULL if it has not been written yet
+    eventsClose() - Unmap the log
+
+    Example:
+        struct vfc_events l;
+        if(eventsOpen(&l, "/home/vfc/.vfc/events.log") == 1)
+            for(const struct vfc_event* e; (e = eventsAt(&l, next)) != NULL; next++)
+                ...
+        eventsClose(&l);
+*/
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ecc.h"
+
+#define EVENTS_MAGIC 0x3130746e76656676 //"vfevnt01"
+#define EVENTS_HEAD 64
+
+#define EVENT_COMMIT 1
+#define EVENT_BASE 2
+#define EVENT_REWIND 3
+
+struct vfc_events_head
+{
+    uint64_t magic;
+    uint64_t esize;     //sizeof(struct vfc_event)
+    uint64_t count;     //events written, published after the event
+    uint64_t pad[5];
+};
+
+struct vfc_event
+{
+    uint64_t seq;               //its number in the log
+    uint32_t type;
+    uint32_t when;              //epoch it was logged at
+    uint64_t height;            //chain height after the event
+    int64_t from_bal;           //balances after the transaction
+    int64_t to_bal;
+    uint64_t uid;               //the transaction, as stored in blocks.dat
+    uint8_t from[ECC_CURVE+1];
+    uint8_t to[ECC_CURVE+1];
+    uint8_t pad[2];
+    uint32_t amount;
+    uint8_t sig[ECC_CURVE*2];
+    uint64_t crc;               //crc64 of the event with this zeroed, checked by the node on startup
+};
+
+struct vfc_events
+{
+    struct vfc_events_head* h;
+    size_t len;
+    int fd;
+};
+
+static inline void eventsClose(struct vfc_events* l)
+{
+    if(l->h != NULL)
+        munmap(l->h, l->len);
+    if(l->fd != -1)
+        close(l->fd);
+    l->h = NULL;
+    l->len = 0;
+    l->fd = -1;
+}
+
+//Map whatever the file holds now, the log grows under the reader
+static inline int eventsMap(struct vfc_events* l)
+{
+    struct stat st;
+    if(fstat(l->fd, &st) != 0 || st.st_size < EVENTS_HEAD)
+        return 0;
+    if(l->h != NULL && (size_t)st.st_size == l->len)
+        return 1;
+
+    struct vfc_events_head* h = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, l->fd, 0);
+    if(h == MAP_FAILED)
+        return 0;
+    if(l->h != NULL)
+        munmap(l->h, l->len);
+    l->h = h;
+    l->len = st.st_size;
+    return 1;
+}
+
+static inline int eventsOpen(struct vfc_events* l, const char* path)
+{
+    l->h = NULL;
+    l->len = 0;
+    l->fd = open(path, O_RDONLY);
+    if(l->fd < 0)
+        return 0;
+
+    if(eventsMap(l) == 0 || l->h->magic != EVENTS_MAGIC || l->h->esize != sizeof(struct vfc_event))
+    {
+        eventsClose(l);
+        return 0;
+    }
+
+    return 1;
+}
+
+static inline uint64_t eventsCount(const struct vfc_events* l)
+{
+    return __atomic_load_n(&l->h->count, __ATOMIC_ACQUIRE);
+}
+
+static inline const struct vfc_event* eventsAt(struct vfc_events* l, const uint64_t n)
+{
+    if(n >= eventsCount(l))
+        return NULL;
+
+    const size_t end = EVENTS_HEAD + (n+1)*sizeof(struct vfc_event);
+    if(end > l->len && (eventsMap(l) == 0 || end > l->len))
+        return NULL;
+
+    return (const struct vfc_event*)((const unsigned char*)l->h + EVENTS_HEAD + n*sizeof(struct vfc_event));
+}
+
+#endif
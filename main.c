@@ -90,6 +90,7 @@
 #include <fcntl.h> //open
 #include <time.h> //time
 #include <sys/mman.h> //mmap
+#include <sys/uio.h> //pwritev
 #include <unistd.h> //sleep
 #include <sys/utsname.h> //uname
 #include <locale.h> //setlocale
@@ -97,11 +98,18 @@
 #include <pthread.h> //Threading
 #include <execinfo.h> //backtrace
 #include <netdb.h> //gethostbyname
+#include <sys/un.h> //local query socket
+#include <errno.h> //errno
+#include <stddef.h> //offsetof
+#include <sys/syscall.h> //fallocate
+#include <linux/falloc.h> //hole punching
 
 #include "ecc.h"
 #include "sha3.h"
 #include "crc64.h"
 #include "base58.h"
+#include "replica.h"
+#include "events.h"
 
 #include "reward.h"
 
@@ -131,6 +139,10 @@ const uint16_t gport = 8787;
 #define MAX_PEER_EXPIRE_SECONDS 10800   // Seconds before a peer can be replaced by another peer. secs(3 days=259200, 3 hours=10800)
 #define PING_INTERVAL 270               // How often to ping the peers and see if they are still alive
 #define REPLAY_SIZE 6944                // How many transactions to send a peer in one replay request , 2mb 13888 / 1mb 6944
+#define MAX_SUBG_CACHE 4194304          // Maximum keys held in the subG valuation cache before it starts over
+#define SENDER_COOLDOWN 3               // Seconds a sender's transaction waits in the queue, another to a new recipient within it is a double spend
+#define MAX_COOLDOWN 65536              // Sender cooldown entries before the expired ones are swept
+#define SENDER_STRIPES 1024             // Sender lock stripes, transactions from senders on different stripes commit in parallel (power of two)
 #define MAX_THREADS_BUFF 512            // Maximum threads allocated for replay, dynamic scale cannot exceed this. [replay sends]
 
 //Peer flood protection
@@ -143,7 +155,27 @@ uint PEER_TRANSACTION_LIMIT_PER_MINUTE = 180; // 180 = 3 unique transactions per
 //Chain Paths
 #define CHAIN_FILE ".vfc/blocks.dat"
 #define BADCHAIN_FILE ".vfc/bad_blocks.dat"
+#define BADIDX_FILE ".vfc/bad.idx"
 #define CONFIG_FILE ".vfc/vfc.cnf"
+#define UIDX_FILE ".vfc/uid.idx"
+#define AIDX_FILE ".vfc/addr.idx"
+#define APST_FILE ".vfc/addr.pst"
+#define LEDGER_CHK_FILE ".vfc/ledger.chk"
+#define QUERY_SOCK ".vfc/vfc.sock"
+#define HEIGHT_FILE ".vfc/height.mem"
+#define TIME_FILE ".vfc/time.idx"
+#define PRUNED_FILE ".vfc/pruned.mem"
+#define PRUNED_UID_FILE ".vfc/pruned.uid"
+#define ARCHIVE_FILE ".vfc/archive.dat"
+#define REPLICA_FILE ".vfc/ledger.shm"
+#define HIST_FILE ".vfc/history.chk"
+#define WATCH_FILE ".vfc/watch.txt"
+#define EVENTS_FILE ".vfc/events.log"
+#define SEG_FILE ".vfc/segments.dat"
+#define COLS_FILE ".vfc/cols.idx"
+#define FROM_COL_FILE ".vfc/from.col"
+#define TO_COL_FILE ".vfc/to.col"
+#define AMOUNT_COL_FILE ".vfc/amount.col"
 
 //Vairable Definitions
 #define uint uint32_t
@@ -176,6 +208,11 @@ pthread_mutex_t mutex3 = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t mutex4 = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t mutex5 = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t mutex6 = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mutex7 = PTHREAD_MUTEX_INITIALIZER; //ledger & pending
+pthread_mutex_t mutex8 = PTHREAD_MUTEX_INITIALIZER; //uid & address indexes
+pthread_mutex_t mutex9 = PTHREAD_MUTEX_INITIALIZER; //subG valuation cache
+pthread_mutex_t mutex10 = PTHREAD_MUTEX_INITIALIZER; //query result cache
+pthread_mutex_t mutex11 = PTHREAD_MUTEX_INITIALIZER; //append writer queue, always locked as the writer is a thread of its own
 
 //User-Configurable
 uint single_threaded = 0;
@@ -585,6 +622,368 @@ void add_uid(const uint64_t uid, const uint expire_seconds) //Pub
     }
 }
 
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Address Hashmap
+
+    Open addressing (linear probe) hashmap keyed by public address. The
+    entries are user defined structures that must begin with the members
+    of `struct amap_ent`, the rest of the entry is the value.
+
+    It is not thread-safe, callers lock around it.
+
+    amap_init() - Allocate a map with entries of x size
+    amap_get() - Find an entry, NULL if it does not exist
+    amap_put() - Find an entry or insert a zeroed one
+    amap_del() - Remove an entry
+    amap_free() - Release the map
+
+*/
+
+struct amap_ent
+{
+    addr key;
+    uint8_t used;
+};
+
+struct amap
+{
+    unsigned char* e; //entries
+    size_t esize;     //size of one entry
+    size_t cap;       //number of slots (power of two)
+    size_t num;       //used slots
+    uint64_t salt;    //hash seed
+};
+
+inline static uint64_t addrHash(const uint64_t salt, const uint8_t* key)
+{
+    //Compressed public keys are random after the first byte, mix the 32 key bytes with a seed so slots can't be targeted
+    uint64_t h = salt, w;
+    for(uint i = 1; i < ECC_CURVE+1; i += sizeof(uint64_t))
+    {
+        memcpy(&w, key+i, sizeof(uint64_t));
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 32;
+    }
+    return h ^ key[0];
+}
+
+inline static struct amap_ent* amap_slot(const struct amap* m, const size_t i)
+{
+    return (struct amap_ent*)(m->e + (i * m->esize));
+}
+
+void amap_init(struct amap* m, const size_t esize, const size_t icap)
+{
+    size_t cap = 64;
+    while(cap < icap)
+        cap *= 2;
+
+    m->esize = esize;
+    m->cap = cap;
+    m->num = 0;
+    m->salt = ((uint64_t)time(0) << 32) ^ ((uint64_t)getpid() << 16) ^ (uint64_t)(size_t)m ^ 0xA5A5F00DCAFEULL;
+    m->e = calloc(cap, esize);
+    if(m->e == NULL)
+    {
+        perror("Failed to allocate memory for an Address Hashmap.\n");
+        exit(0);
+    }
+}
+
+void amap_free(struct amap* m)
+{
+    free(m->e);
+    m->e = NULL;
+    m->cap = 0;
+    m->num = 0;
+}
+
+void* amap_get(const struct amap* m, const uint8_t* key)
+{
+    if(m->e == NULL)
+        return NULL;
+
+    const size_t mask = m->cap-1;
+    for(size_t i = addrHash(m->salt, key) & mask;; i = (i+1) & mask)
+    {
+        struct amap_ent* s = amap_slot(m, i);
+        if(s->used == 0)
+            return NULL;
+        if(memcmp(s->key.key, key, ECC_CURVE+1) == 0)
+            return s;
+    }
+}
+
+void* amap_put(struct amap* m, const uint8_t* key)
+{
+    //Grow at 70% load
+    if((m->num+1)*10 >= m->cap*7)
+    {
+        struct amap n;
+        n.esize = m->esize;
+        n.cap = m->cap*2;
+        n.num = 0;
+        n.salt = m->salt;
+        n.e = calloc(n.cap, n.esize);
+        if(n.e == NULL)
+        {
+            perror("Failed to grow an Address Hashmap.\n");
+            exit(0);
+        }
+
+        const size_t mask = n.cap-1;
+        for(size_t i = 0; i < m->cap; i++)
+        {
+            struct amap_ent* s = amap_slot(m, i);
+            if(s->used == 0)
+                continue;
+
+            size_t j = addrHash(n.salt, s->key.key) & mask;
+            while(amap_slot(&n, j)->used != 0)
+                j = (j+1) & mask;
+            memcpy(amap_slot(&n, j), s, n.esize);
+            n.num++;
+        }
+
+        free(m->e);
+        *m = n;
+    }
+
+    const size_t mask = m->cap-1;
+    for(size_t i = addrHash(m->salt, key) & mask;; i = (i+1) & mask)
+    {
+        struct amap_ent* s = amap_slot(m, i);
+        if(s->used == 0)
+        {
+            memset(s, 0, m->esize);
+            memcpy(s->key.key, key, ECC_CURVE+1);
+            s->used = 1;
+            m->num++;
+            return s;
+        }
+        if(memcmp(s->key.key, key, ECC_CURVE+1) == 0)
+            return s;
+    }
+}
+
+void amap_del(struct amap* m, const uint8_t* key)
+{
+    if(m->e == NULL)
+        return;
+
+    //Find it
+    const size_t mask = m->cap-1;
+    size_t i = addrHash(m->salt, key) & mask;
+    while(1)
+    {
+        struct amap_ent* s = amap_slot(m, i);
+        if(s->used == 0)
+            return;
+        if(memcmp(s->key.key, key, ECC_CURVE+1) == 0)
+            break;
+        i = (i+1) & mask;
+    }
+
+    //Shift back any following entries that probed past the removed slot
+    size_t j = i;
+    while(1)
+    {
+        j = (j+1) & mask;
+        struct amap_ent* s = amap_slot(m, j);
+        if(s->used == 0)
+            break;
+
+        const size_t k = addrHash(m->salt, s->key.key) & mask;
+        if((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j)))
+        {
+            memcpy(amap_slot(m, i), s, m->esize);
+            i = j;
+        }
+    }
+
+    memset(amap_slot(m, i), 0, m->esize);
+    m->num--;
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Chain Height
+
+    The node owns the size of blocks.dat in bytes, it is set once at start
+    and advanced by the append path. The counter lives in a shared mapping
+    of .vfc/height.mem so the CLI reads the same value while the node runs,
+    without a stat() of the chain on every request.
+
+    heightInit() - Create the shared counter from the chain (node only)
+    heightSet() - Publish the chain size after an append
+    heightClose() - Mark the counter as no longer maintained
+    getChainSize() - Chain size in bytes, stat() when no node maintains it
+    chainPruned() - Records at the front of the chain a pruned node has released
+    chainWhole() - 0 with a message for a command that needs the whole chain when it was pruned
+    recordDigest() - Term a record adds to the chain digest
+    chainDigest() - Digest of the set of records and the height it covers (node only)
+
+    The chain digest is the sum of a hash of every record, two nodes holding the
+    same set of transactions have the same digest whatever order they were
+    appended in. It is advanced with the ledger and carried by its snapshots.
+
+*/
+
+#define HEIGHT_MAGIC 0x3130746867686676 //"vfhght01"
+
+struct chain_height
+{
+    uint64_t magic;
+    uint64_t pid;   //process maintaining the counter
+    uint64_t size;  //blocks.dat size in bytes
+};
+
+struct chain_height* chain_height = NULL;
+uint chain_height_owner = 0;
+size_t chain_pruned = 0; //records below this read back as zeros
+uint64_t chain_digest = 0;      //sum of recordDigest() over the records applied to the ledger
+size_t chain_digest_height = 0; //records in chain_digest, zero without a ledger
+
+void heightInit()
+{
+    struct stat st;
+    if(stat(CHAIN_FILE, &st) != 0)
+        st.st_size = 0;
+
+    const int f = open(HEIGHT_FILE, O_RDWR | O_CREAT, 0644);
+    if(f < 0 || ftruncate(f, sizeof(struct chain_height)) != 0)
+    {
+        printf("ERROR: Could not create %s, height will be read from the chain.\n", HEIGHT_FILE);
+        err++;
+        if(f > -1)
+            close(f);
+        return;
+    }
+
+    struct chain_height* h = mmap(NULL, sizeof(struct chain_height), PROT_READ | PROT_WRITE, MAP_SHARED, f, 0);
+    close(f);
+    if(h == MAP_FAILED)
+        return;
+
+    __atomic_store_n(&h->size, (uint64_t)st.st_size, __ATOMIC_RELEASE);
+    h->pid = getpid();
+    __atomic_store_n(&h->magic, HEIGHT_MAGIC, __ATOMIC_RELEASE);
+    chain_height = h;
+    chain_height_owner = 1;
+}
+
+void heightSet(const uint64_t size)
+{
+    if(chain_height_owner == 1)
+        __atomic_store_n(&chain_height->size, size, __ATOMIC_RELEASE);
+}
+
+void heightClose()
+{
+    if(chain_height_owner == 1)
+    {
+        __atomic_store_n(&chain_height->pid, 0, __ATOMIC_RELEASE);
+        msync(chain_height, sizeof(struct chain_height), MS_SYNC);
+    }
+}
+
+size_t getChainSize()
+{
+    //Map the node's counter once, it is only trusted while that node is alive
+    static uint tried = 0;
+    if(chain_height == NULL && tried == 0)
+    {
+        tried = 1;
+        struct stat st;
+        const int f = open(HEIGHT_FILE, O_RDONLY);
+        if(f > -1 && fstat(f, &st) == 0 && st.st_size >= (off_t)sizeof(struct chain_height))
+        {
+            struct chain_height* h = mmap(NULL, sizeof(struct chain_height), PROT_READ, MAP_SHARED, f, 0);
+            if(h != MAP_FAILED)
+                chain_height = h;
+        }
+        if(f > -1)
+            close(f);
+    }
+
+    if(chain_height != NULL)
+    {
+        if(chain_height_owner == 1)
+            return __atomic_load_n(&chain_height->size, __ATOMIC_ACQUIRE);
+
+        const pid_t pid = __atomic_load_n(&chain_height->pid, __ATOMIC_ACQUIRE);
+        if(chain_height->magic == HEIGHT_MAGIC && pid > 0 && (kill(pid, 0) == 0 || errno == EPERM))
+            return __atomic_load_n(&chain_height->size, __ATOMIC_ACQUIRE);
+    }
+
+    struct stat st;
+    if(stat(CHAIN_FILE, &st) != 0 || st.st_size < 0)
+        return 0;
+    return st.st_size;
+}
+
+uint64_t recordDigest(const struct trans* t)
+{
+    uint8_t h[ECC_CURVE];
+    makHash(h, t);
+    uint64_t d;
+    memcpy(&d, h, sizeof(uint64_t));
+    return d;
+}
+
+uint chainDigest(uint64_t* digest, size_t* height)
+{
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    *digest = chain_digest;
+    *height = chain_digest_height;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    return *height != 0;
+}
+
+size_t chainPruned()
+{
+    uint64_t n = 0;
+    FILE* f = fopen(PRUNED_FILE, "r");
+    if(f)
+    {
+        if(fread(&n, sizeof(uint64_t), 1, f) != 1)
+            n = 0;
+        fclose(f);
+    }
+    return n;
+}
+
+uint chainWhole()
+{
+    if(chainPruned() == 0)
+        return 1;
+    printf("blocks.dat has been pruned, this command needs the whole chain.\n\n");
+    return 0;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////
 //////////////////////////////////////////////
@@ -741,29 +1140,22 @@ double isSubDiff(uint8_t *a)
 }
 
 //This is the algorthm to check if a genesis address is a valid "SubGenesis" address
-uint64_t isSubGenesisAddress(uint8_t *a, const uint fr)
+//subG valuation cache entry
+struct vent
 {
-    //Is this requesting the genesis balance
-    if(memcmp(a, genesis_pub, ECC_CURVE+1) == 0)
-    {
-        //Get the tax
-        struct stat st;
-        stat(CHAIN_FILE, &st);
-        uint64_t ift = 0;
-        if(st.st_size > 0)
-            ift = (uint64_t)st.st_size / sizeof(struct trans);
-        else
-            return 0;
-        
-        ift *= INFLATION_TAX; //every transaction inflates vfc by 1 VFC (1000v). This is a TAX paid to miners.
-        return ift;
-    }
-
-    //Requesting the balance of a possible existing subG address
+    addr key;
+    uint8_t used;
+    double maxa;    //largest of the four normal angles
+    uint64_t val;   //value of the address if it is a hit
+};
+struct amap subg_cache;
 
+//Largest of the four normal angles of a key and its value if they are all under the difficulty
+static void subgValuation(const uint8_t *a, double* maxa, uint64_t* val)
+{
     vec3 v[5]; //Vectors
 
-    uint8_t *ofs = a;
+    const uint8_t *ofs = a;
     memcpy(&v[0].x, ofs, sizeof(uint16_t));
     memcpy(&v[0].y, ofs + sizeof(uint16_t), sizeof(uint16_t));
     memcpy(&v[0].z, ofs + (sizeof(uint16_t)*2), sizeof(uint16_t));
@@ -793,27 +1185,94 @@ uint64_t isSubGenesisAddress(uint8_t *a, const uint fr)
     const double a3 = gNa(&v[2], &v[1]);
     const double a4 = gNa(&v[1], &v[4]);
 
-    //All normal angles a1-a4 must be under this value
-    const double min = fr == 0 ? getMiningDifficulty() : 0.24;
+    *maxa = a1;
+    if(a2 > *maxa)
+        *maxa = a2;
+    if(a3 > *maxa)
+        *maxa = a3;
+    if(a4 > *maxa)
+        *maxa = a4;
+
+    //Calculate value of address mined
+    *val = 0;
+    const double at = (a1+a2+a3+a4);
+    if(at <= 0)
+        return; //not want zero address.
+    const double ra = at/4;
+    const double mn = 4.166666667; //(1/min);
+    *val = (uint64_t)floor(( 1000 + ( 10000*(1-(ra*mn)) ) )+0.5);
+}
 
-    //printf("%.3f - %.3f - %.3f - %.3f > %.3f\n", a1,a2,a3,a4,min);
-    
-    //Was it a straight hit?
-    if(a1 < min && a2 < min && a3 < min && a4 < min)
+uint64_t isSubGenesisAddress(uint8_t *a, const uint fr)
+{
+    //Is this requesting the genesis balance
+    if(memcmp(a, genesis_pub, ECC_CURVE+1) == 0)
     {
-        //Calculate and return value of address mined
-        const double at = (a1+a2+a3+a4);
-        if(at <= 0)
-            return 0; //not want zero address.
-        const double ra = at/4;
-        const double mn = 4.166666667; //(1/min);
-        const uint64_t rv = (uint64_t)floor(( 1000 + ( 10000*(1-(ra*mn)) ) )+0.5);
+        //Get the tax
+        const size_t size = getChainSize();
+        uint64_t ift = 0;
+        if(size > 0)
+            ift = (uint64_t)size / sizeof(struct trans);
+        else
+            return 0;
+        
+        ift *= INFLATION_TAX; //every transaction inflates vfc by 1 VFC (1000v). This is a TAX paid to miners.
+        return ift;
+    }
 
-        return rv;
+    //Requesting the balance of a possible existing subG address
+
+    //The angles only depend on the key, so they are cached and the difficulty applied after
+    double maxa = 0;
+    uint64_t val = 0;
+    uint cached = 0;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex9);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    if(subg_cache.cap == 0)
+        amap_init(&subg_cache, sizeof(struct vent), 4096);
+    const struct vent* e = amap_get(&subg_cache, a);
+    if(e != NULL)
+    {
+        maxa = e->maxa;
+        val = e->val;
+        cached = 1;
     }
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex9);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-    return 0;
+    if(cached == 0)
+    {
+        subgValuation(a, &maxa, &val);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex9);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        if(subg_cache.num >= MAX_SUBG_CACHE) //start over rather than grow without bound
+        {
+            amap_free(&subg_cache);
+            amap_init(&subg_cache, sizeof(struct vent), 4096);
+        }
+        struct vent* n = amap_put(&subg_cache, a);
+        n->maxa = maxa;
+        n->val = val;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex9);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    }
+
+    //All normal angles a1-a4 must be under this value
+    const double min = fr == 0 ? getMiningDifficulty() : 0.24;
 
+    //Was it a straight hit?
+    if(maxa < min)
+        return val;
+
+    return 0;
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -836,6 +1295,7 @@ uint64_t isSubGenesisAddress(uint8_t *a, const uint fr)
     
     addPeer() - Add a peer address to the peers (if free space available)
     isPeer() - Check if peer already exists in list.
+    nonpeerCount() - Transactions a sender that is not a peer relayed this minute
     
     peersBroadcast() - Broadcast a packet to the peers (skipping master)
 
@@ -847,6 +1307,10 @@ time_t peer_timeouts[MAX_PEERS]; //Peer timeout UNIX epoch stamps
 uint num_peers = 0; //Current number of indexed peers
 uint peer_tcount[MAX_PEERS]; //Amount of transactions relayed by peer
 uint peer_ltcount[MAX_PEERS]; //delta tcount for flood protection / rate limiting
+#define NONPEER_SLOTS 4096 //senders that are not peers tracked per minute (power of two)
+#define NONPEER_PROBE 8
+uint nonpeer_ip[NONPEER_SLOTS]; //IPv4 address of the sender in the slot
+uint nonpeer_ltcount[NONPEER_SLOTS]; //delta tcount of a sender that is not a peer, reset with peer_ltcount
 char peer_ua[MAX_PEERS][64]; //Peer user agent
 time_t peer_rm[MAX_PEERS]; //Last time peer responded to a mid request
 
@@ -986,18 +1450,29 @@ void peersBroadcast(const char* dat, const size_t len)
         csend(peers[i], dat, len);
 }
 
-void broadcastUserAgent()
+//The digest goes before the difficulty, older nodes read the difficulty from the end
+uint userAgent(char* pc, const size_t len)
 {
-    struct stat st;
-    stat(CHAIN_FILE, &st);
+    const size_t height = getChainSize() / sizeof(struct trans);
+    if(height == 0)
+        return 0;
+
     struct utsname ud;
     uname(&ud);
+    uint64_t digest;
+    size_t dh;
+    if(chainDigest(&digest, &dh) == 1)
+        snprintf(pc, len, "a%lu, %s, %u, %s, %016lx, %.3f", dh, version, num_processors, ud.machine, digest, node_difficulty);
+    else
+        snprintf(pc, len, "a%lu, %s, %u, %s, %.3f", height, version, num_processors, ud.machine, node_difficulty);
+    return 1;
+}
+
+void broadcastUserAgent()
+{
     char pc[MIN_LEN];
-    if(st.st_size > 0)
-    {
-        snprintf(pc, sizeof(pc), "a%lu, %s, %u, %s, %.3f", st.st_size / sizeof(struct trans), version, num_processors, ud.machine, node_difficulty);
+    if(userAgent(pc, sizeof(pc)) == 1)
         peersBroadcast(pc, strlen(pc));
-    }
 }
 
 void triBroadcast(const char* dat, const size_t len, const uint multi)
@@ -1084,13 +1559,39 @@ int getPeer(const uint ip)
     return -1;
 }
 
+uint* nonpeerCount(const uint ip)
+{
+    //Senders colliding past the probe share the last slot, a flood can't grow the table
+    const uint h = (ip * 2654435761U) & (NONPEER_SLOTS-1);
+    uint s = h;
+    for(uint i = 0; i < NONPEER_PROBE; i++)
+    {
+        s = (h + i) & (NONPEER_SLOTS-1);
+        if(nonpeer_ip[s] == ip)
+            return &nonpeer_ltcount[s];
+        if(nonpeer_ltcount[s] == 0)
+        {
+            nonpeer_ip[s] = ip;
+            return &nonpeer_ltcount[s];
+        }
+    }
+    return &nonpeer_ltcount[s];
+}
+
 size_t getPeerHeigh(const uint id)
 {
-    const char* str = strtok(peer_ua[id], ",");
-    if(str != NULL)
-        return strtoul(str, NULL, 10);
-    else
+    //strtoul() stops at the first comma, the user agent is left intact for getPeerDiff()
+    return strtoul(peer_ua[id], NULL, 10);
+}
+
+//0 when the peer does not advertise a digest
+uint getPeerDigest(const uint id, uint64_t* digest)
+{
+    char hex[17];
+    if(sscanf(peer_ua[id], "%*u, %*[^,], %*u, %*[^,], %16[0-9a-f]", hex) != 1 || strlen(hex) != 16)
         return 0;
+    *digest = strtoull(hex, NULL, 16);
+    return 1;
 }
 
 float getPeerDiff(const uint id)
@@ -1281,7 +1782,490 @@ pthread_mutex_unlock(&mutex4);
 //
 //
 //
-/* ~ Transaction Queue
+/* ~ Pending
+
+    Credits and debits of the transactions waiting in the queue, per address,
+    so a confirmed + in-flight balance does not need a walk of tq[]. Entries are
+    added by aQue() and removed when processThread() pops the transaction or a
+    double spend terminates it, replays and transactions to self are not tracked.
+    The queue marks the slots it counted, so a slot popped and terminated at
+    the same time is only removed once.
+
+    pendingAdd() - Track a queued transaction (caller locks mutex7)
+    pendingRemove() - Stop tracking a queued transaction (caller locks mutex7)
+    pendingGet() - Queued credits and debits of an address (caller locks mutex7)
+
+*/
+
+struct pent //pending entry
+{
+    addr key;
+    uint8_t used;
+    uint32_t num;   //queued transactions touching the address
+    uint64_t in;
+    uint64_t out;
+};
+
+struct amap pending;
+
+static void pendingAdjust(const uint8_t* key, const int64_t in, const int64_t out, const int n)
+{
+    if(pending.cap == 0)
+        amap_init(&pending, sizeof(struct pent), 1024);
+
+    struct pent* e = amap_put(&pending, key);
+    e->in += in;
+    e->out += out;
+    e->num += n;
+    if(e->num == 0)
+        amap_del(&pending, key);
+}
+
+void pendingAdd(const struct trans* t)
+{
+    if(memcmp(t->from.key, t->to.key, ECC_CURVE+1) == 0)
+        return;
+    pendingAdjust(t->to.key, t->amount, 0, 1);
+    pendingAdjust(t->from.key, 0, t->amount, 1);
+}
+
+void pendingRemove(const struct trans* t)
+{
+    if(memcmp(t->from.key, t->to.key, ECC_CURVE+1) == 0)
+        return;
+    pendingAdjust(t->to.key, -(int64_t)t->amount, 0, -1);
+    pendingAdjust(t->from.key, 0, -(int64_t)t->amount, -1);
+}
+
+void pendingGet(const addr* a, uint64_t* in, uint64_t* out)
+{
+    *in = 0;
+    *out = 0;
+    if(pending.cap == 0)
+        return;
+
+    const struct pent* e = amap_get(&pending, a->key);
+    if(e != NULL)
+    {
+        *in = e->in;
+        *out = e->out;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Sender Cooldown
+
+    The last accepted transaction of each sender and when it was accepted, so
+    aQue() finds a queued transaction from the same sender with one lookup
+    instead of a walk of tq[]. The sender's transactions still queued are
+    counted, when the last one already left the queue but others have not
+    aQue() walks tq[] for them. Entries expire lazily once nothing of the
+    sender is queued, an old entry is dropped when it is looked up and the
+    table is swept when it fills.
+
+    The reason a transaction was refused is counted. Refusals that are not
+    repeats of gossip are also kept on the sender for a minute, so they can
+    be queried through the local socket.
+
+    coolGet() - Sender's entry if it has not expired (caller locks mutex5)
+    coolAccept() - Record an accepted transaction (caller locks mutex5)
+    coolRelease() - An accepted transaction left the queue (caller locks mutex5)
+    coolThrottle() - Count a refusal, on the sender if known (caller locks mutex5)
+    coolStatus() - Remaining cooldown & last refusal of a sender (caller locks mutex5)
+
+*/
+
+#define THROTTLE_NONE 0
+#define THROTTLE_AUTH_REPEAT 1
+#define THROTTLE_NOT_PEER 2
+#define THROTTLE_UID_BLOCKED 3
+#define THROTTLE_UID_QUEUED 4
+#define THROTTLE_DOUBLE_SPEND 5
+#define THROTTLE_QUEUE_FULL 6
+#define THROTTLE_PEER_LIMIT 7
+#define THROTTLE_REASONS 8
+
+const char* throttle_names[THROTTLE_REASONS] = {"none", "auth repeat", "not a peer", "uid blocked", "already queued", "double spend", "queue full", "peer limit"};
+uint64_t throttle_count[THROTTLE_REASONS];
+
+#define COOLDOWN_MEMORY 60 //seconds an entry is kept after it was last used
+
+struct cent //cooldown entry
+{
+    addr key;
+    uint8_t used;
+    uint8_t reason;     //last refusal
+    uint32_t slot;      //tq[] index of the last accepted transaction
+    uint64_t uid;       //uid of the last accepted transaction
+    uint32_t queued;    //its transactions still in tq[]
+    time_t last;        //when the last transaction was accepted
+    time_t throttled;   //when the last refusal happened
+};
+
+struct amap cooldown;
+
+static uint coolLive(const struct cent* e, const time_t now)
+{
+    return e->queued > 0 || now - e->last < COOLDOWN_MEMORY || now - e->throttled < COOLDOWN_MEMORY;
+}
+
+static void coolSweep(const time_t now)
+{
+    struct amap m;
+    amap_init(&m, sizeof(struct cent), MAX_COOLDOWN);
+    for(size_t i = 0; i < cooldown.cap; i++)
+    {
+        const struct cent* e = (struct cent*)(cooldown.e + (i * cooldown.esize));
+        if(e->used == 1 && coolLive(e, now) == 1)
+            memcpy(amap_put(&m, e->key.key), e, sizeof(struct cent));
+    }
+    amap_free(&cooldown);
+    cooldown = m;
+}
+
+struct cent* coolGet(const uint8_t* key, const time_t now)
+{
+    if(cooldown.cap == 0)
+        return NULL;
+
+    struct cent* e = amap_get(&cooldown, key);
+    if(e != NULL && coolLive(e, now) == 0)
+    {
+        amap_del(&cooldown, key);
+        return NULL;
+    }
+    return e;
+}
+
+static struct cent* coolPut(const uint8_t* key, const time_t now)
+{
+    if(cooldown.cap == 0)
+        amap_init(&cooldown, sizeof(struct cent), 1024);
+    else if(cooldown.num >= MAX_COOLDOWN && amap_get(&cooldown, key) == NULL)
+        coolSweep(now);
+
+    struct cent* e = coolGet(key, now);
+    if(e == NULL)
+        e = amap_put(&cooldown, key);
+    return e;
+}
+
+void coolAccept(const struct trans* t, const uint slot, const time_t now)
+{
+    struct cent* e = coolPut(t->from.key, now);
+    e->slot = slot;
+    e->uid = t->uid;
+    e->queued++;
+    e->last = now;
+}
+
+void coolRelease(const uint8_t* key)
+{
+    struct cent* e = cooldown.cap != 0 ? amap_get(&cooldown, key) : NULL;
+    if(e != NULL && e->queued > 0)
+        e->queued--;
+}
+
+void coolThrottle(const uint8_t* key, const uint reason)
+{
+    if(reason >= THROTTLE_REASONS)
+        return;
+    throttle_count[reason]++;
+
+    if(key != NULL)
+    {
+        const time_t now = time(0);
+        struct cent* e = coolPut(key, now);
+        e->reason = reason;
+        e->throttled = now;
+    }
+}
+
+void coolStatus(const uint8_t* key, uint* remaining, uint* reason)
+{
+    *remaining = 0;
+    *reason = THROTTLE_NONE;
+
+    const time_t now = time(0);
+    const struct cent* e = coolGet(key, now);
+    if(e != NULL)
+    {
+        if(now - e->last < SENDER_COOLDOWN)
+            *remaining = SENDER_COOLDOWN - (now - e->last);
+        if(now - e->throttled < COOLDOWN_MEMORY)
+            *reason = e->reason;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Double Spend Journal
+
+    Both transactions of a detected double spend are logged to bad_blocks.dat.
+    aQue() only copies them into a ring, a background thread appends them to
+    the file so the queue lock is never held over file I/O. The ring has one
+    producer at a time (aQue() holds mutex5) and one consumer, the head and
+    tail are the only shared state. When the ring is full the event is dropped
+    and counted rather than blocking the network threads.
+
+    .vfc/bad.idx keys every record in bad_blocks.dat by its sender so the
+    attempts of one address are found with a binary search per run rather
+    than a walk of the whole file. Each sync sorts the records it indexes by
+    sender into a run appended to the file, when BAD_RUNS runs exist they are
+    merged into one. Runs follow each other in journal order so the matches
+    of consecutive runs stay in record order. It is brought up to date from
+    bad_blocks.dat, a cleared file starts it over.
+
+    badPush() - Hand a double spend to the writer (caller locks mutex5)
+    badThread() - Append queued double spends to the journal (node only)
+    badIndexSync() - Index the records not yet in bad.idx
+    dumpbadAddr() - Print the double spends of one sender
+
+*/
+
+#define BAD_RING 4096               //double spends held for the writer (power of two)
+#define BAD_RUNS 16                 //sorted runs in bad.idx before they are merged
+#define BADIDX_MAGIC 0x3230786461626676 //"vfbadx02"
+
+struct bad_event
+{
+    struct trans t[2];              //original queued transaction, conflicting transaction
+};
+
+struct bad_entry
+{
+    addr key;
+    uint8_t pad[7];
+    uint64_t rec;                   //record number in bad_blocks.dat
+};
+
+struct bad_head
+{
+    uint64_t magic;
+    uint64_t recs;                  //records indexed, the entries of all runs
+    uint64_t runs;
+    uint64_t len[BAD_RUNS];         //entries of each run, sorted by sender then record
+};
+
+struct bad_event bad_ring[BAD_RING];
+uint64_t bad_head = 0;              //next slot written by aQue()
+uint64_t bad_tail = 0;              //next slot read by badThread()
+uint64_t bad_dropped = 0;
+uint bad_writer = 0;                //a writer thread is draining the ring
+
+static void badWrite(const struct trans* t, const size_t n)
+{
+    const int f = open(BADCHAIN_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if(f == -1)
+        return;
+    if(write(f, t, n*sizeof(struct trans)) != (ssize_t)(n*sizeof(struct trans)))
+    {
+        printf("ERROR: write() to %s failed.\n", BADCHAIN_FILE);
+        err++;
+    }
+    close(f);
+}
+
+void badPush(const struct trans* a, const struct trans* b)
+{
+    //Without a writer, log in place
+    if(bad_writer == 0)
+    {
+        struct trans p[2];
+        memcpy(&p[0], a, sizeof(struct trans));
+        memcpy(&p[1], b, sizeof(struct trans));
+        badWrite(p, 2);
+        return;
+    }
+
+    const uint64_t h = bad_head;
+    if(h - __atomic_load_n(&bad_tail, __ATOMIC_ACQUIRE) >= BAD_RING)
+    {
+        bad_dropped++;
+        return;
+    }
+
+    memcpy(&bad_ring[h & (BAD_RING-1)].t[0], a, sizeof(struct trans));
+    memcpy(&bad_ring[h & (BAD_RING-1)].t[1], b, sizeof(struct trans));
+    __atomic_store_n(&bad_head, h+1, __ATOMIC_RELEASE);
+}
+
+int badCompare(const void* a, const void* b)
+{
+    const struct bad_entry* x = a;
+    const struct bad_entry* y = b;
+    const int r = memcmp(x->key.key, y->key.key, ECC_CURVE+1);
+    if(r != 0)
+        return r;
+    return x->rec < y->rec ? -1 : x->rec > y->rec;
+}
+
+//Is the header consistent with a journal of recs records & an index file of len bytes
+static uint badValid(const struct bad_head* h, const size_t recs, const size_t len)
+{
+    if(h->magic != BADIDX_MAGIC || h->recs > recs || h->runs > BAD_RUNS || len < sizeof(struct bad_head) + h->recs*sizeof(struct bad_entry))
+        return 0;
+    uint64_t n = 0;
+    for(uint64_t r = 0; r < h->runs; r++)
+        n += h->len[r];
+    return n == h->recs;
+}
+
+void badIndexSync()
+{
+    const int f = open(BADCHAIN_FILE, O_RDONLY);
+    const size_t recs = f == -1 ? 0 : lseek(f, 0, SEEK_END) / sizeof(struct trans);
+
+    const int x = open(BADIDX_FILE, O_RDWR | O_CREAT, 0644);
+    if(x == -1)
+    {
+        if(f != -1)
+            close(f);
+        return;
+    }
+
+    //A foreign header, or more indexed than the journal holds (cleared), starts over
+    struct bad_head h;
+    if(pread(x, &h, sizeof(h), 0) != sizeof(h) || badValid(&h, recs, lseek(x, 0, SEEK_END)) == 0)
+    {
+        memset(&h, 0, sizeof(h));
+        h.magic = BADIDX_MAGIC;
+        if(ftruncate(x, sizeof(h)) != 0)
+            h.recs = recs; //leave it, nothing is indexed
+    }
+    if(h.recs == recs)
+    {
+        close(x);
+        if(f != -1)
+            close(f);
+        return;
+    }
+
+    //The new records make one run, or with all the runs one merged run when they're used up
+    const size_t from = h.runs == BAD_RUNS ? 0 : h.recs;
+    struct bad_entry* e = malloc((recs - from) * sizeof(struct bad_entry));
+    if(e == NULL)
+    {
+        close(x);
+        close(f);
+        return;
+    }
+    size_t n = 0;
+    if(from < h.recs)
+    {
+        if(pread(x, e, h.recs*sizeof(struct bad_entry), sizeof(h)) != (ssize_t)(h.recs*sizeof(struct bad_entry)))
+        {
+            free(e);
+            close(x);
+            close(f);
+            return;
+        }
+        n = h.recs;
+    }
+
+    struct trans t;
+    for(size_t i = h.recs; i < recs; i++, n++)
+    {
+        if(pread(f, &t, sizeof(struct trans), i*sizeof(struct trans)) != sizeof(struct trans))
+            break;
+        memset(&e[n], 0, sizeof(struct bad_entry));
+        memcpy(e[n].key.key, t.from.key, ECC_CURVE+1);
+        e[n].rec = i;
+    }
+    qsort(e, n, sizeof(struct bad_entry), badCompare);
+
+    //The entries are written before the header that counts them
+    if(pwrite(x, e, n*sizeof(struct bad_entry), sizeof(h) + from*sizeof(struct bad_entry)) == (ssize_t)(n*sizeof(struct bad_entry)))
+    {
+        if(from == 0)
+            h.runs = 0;
+        h.len[h.runs++] = n;
+        h.recs = from + n;
+        if(pwrite(x, &h, sizeof(h), 0) != sizeof(h))
+            printf("ERROR: write() to %s failed.\n", BADIDX_FILE);
+    }
+    else
+        printf("ERROR: write() to %s failed.\n", BADIDX_FILE);
+
+    free(e);
+    close(x);
+    close(f);
+}
+
+void *badThread(void *arg)
+{
+    if(chdir(getHome()) == -1)
+    {
+        printf("ERROR: Journal Thread -1 chdir(%s)\n", getHome());
+        exit(0);
+    }
+
+    badIndexSync();
+    bad_writer = 1;
+
+    uint64_t dropped = 0;
+    while(1)
+    {
+        usleep(100000);
+
+        //Everything published before the head was read is complete
+        const uint64_t h = __atomic_load_n(&bad_head, __ATOMIC_ACQUIRE);
+        uint64_t t = bad_tail;
+        if(t == h)
+            continue;
+
+        //Copy out one contiguous run of the ring per write
+        struct trans p[64*2];
+        while(t != h)
+        {
+            size_t n = 0;
+            while(t != h && n < 64)
+            {
+                memcpy(&p[n*2], bad_ring[t & (BAD_RING-1)].t, sizeof(struct trans)*2);
+                n++;
+                t++;
+            }
+            __atomic_store_n(&bad_tail, t, __ATOMIC_RELEASE);
+            badWrite(p, n*2);
+        }
+        badIndexSync();
+
+        if(bad_dropped != dropped)
+        {
+            dropped = bad_dropped;
+            printf("ERROR: The double spend journal was full, %lu events were not logged.\n", dropped);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Transaction Queue
 
     aQue() - Add Transaction to Queue
     gQue() - Return pointer to fist valid transaction
@@ -1295,6 +2279,18 @@ uint ip[MAX_TRANS_QUEUE];
 uint ipo[MAX_TRANS_QUEUE];
 unsigned char replay[MAX_TRANS_QUEUE]; // 1 = not replay, 0 = replay
 time_t delta[MAX_TRANS_QUEUE];
+uint tq_next = 0; //where aQue() looks for a free slot next
+unsigned char pend[MAX_TRANS_QUEUE]; // 1 = counted in pending
+
+//Stop counting a slot in pending, 1 the first time (caller locks mutex7)
+static uint pendingRelease(const uint i)
+{
+    if(pend[i] == 0)
+        return 0;
+    pend[i] = 0;
+    pendingRemove(&tq[i]);
+    return 1;
+}
 
 //size of queue
 uint gQueSize()
@@ -1308,6 +2304,43 @@ uint gQueSize()
     return size;
 }
 
+//Count why a transaction was refused by the Queue
+static uint aQueRefuse(const uint8_t* key, const uint reason)
+{
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex5);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    coolThrottle(key, reason);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex5);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    return 0;
+}
+
+//A queued transaction of the sender to another recipient or with the same uid, -1 if none (caller locks mutex5)
+static int aQueSender(const struct trans* t)
+{
+    for(uint i = 0; i < MAX_TRANS_QUEUE; i++)
+    {
+        if(tq[i].amount == 0 || replay[i] == 0 || memcmp(tq[i].from.key, t->from.key, ECC_CURVE+1) != 0)
+            continue;
+        if(memcmp(tq[i].to.key, t->to.key, ECC_CURVE+1) != 0 || tq[i].uid == t->uid)
+            return i;
+    }
+    return -1;
+}
+
+//A queued transaction with the uid, -1 if none (caller locks mutex5)
+static int aQueUID(const uint64_t uid)
+{
+    for(uint i = 0; i < MAX_TRANS_QUEUE; i++)
+        if(tq[i].amount != 0 && tq[i].uid == uid)
+            return i;
+    return -1;
+}
+
 //Add a transaction to the Queue
 uint aQue(struct trans *t, const uint iip, const uint iipo, const unsigned char ir)
 {
@@ -1322,7 +2355,7 @@ uint aQue(struct trans *t, const uint iip, const uint iipo, const unsigned char
     if(memcmp(t->from.key, t->to.key, ECC_CURVE+1) == 0) //is auth trans
     {
         if(has_uid(crc64(0, (unsigned char*)t->from.key, ECC_CURVE+1)) == 1)
-            return 0;
+            return aQueRefuse(NULL, THROTTLE_AUTH_REPEAT);
     }
     else
     {
@@ -1330,122 +2363,4114 @@ uint aQue(struct trans *t, const uint iip, const uint iipo, const unsigned char
         if((iipo != 0 && isPeer(iip) == 0) || (iipo != 0 && isPeer(iipo) == 0) )
         {
             //printf("NOT-PEER: %lu\n", t->uid);
-            return 0;
+            return aQueRefuse(NULL, THROTTLE_NOT_PEER);
+        }
+
+        //Check it's not on the cache block
+        if(has_uid(t->uid) == 1)
+        {
+            //printf("HAS-UID: %lu\n", t->uid);
+            return aQueRefuse(NULL, THROTTLE_UID_BLOCKED);
         }
+    }
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex5);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    //Is this a possible double spend? the sender's last transaction is found in one lookup
+    const time_t now = time(0);
+    const struct cent* c = ir == 1 ? coolGet(t->from.key, now) : NULL;
+    int qi = -1;
+    if(c != NULL)
+    {
+        if(tq[c->slot].amount != 0 && tq[c->slot].uid == c->uid && replay[c->slot] == 1)
+            qi = c->slot;
+        else if(c->queued > 0)
+            qi = aQueSender(t);
+    }
+    if(qi != -1)
+    {
+        const uint i = qi;
+        if(memcmp(tq[i].to.key, t->to.key, ECC_CURVE+1) != 0)
+        {
+            //Log both blocks in bad_blocks
+            badPush(&tq[i], t);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+            if(pendingRelease(i) == 1)
+                coolRelease(tq[i].from.key);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+            tq[i].amount = 0; //It looks like it could be a double spend, terminate the original transaction
+            add_uid(t->uid, 30); //block uid 30 seconds
+            add_uid(tq[i].uid, 30); //block original uid 30 seconds
+            coolThrottle(t->from.key, THROTTLE_DOUBLE_SPEND);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex5);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+            return 2; //Don't process this transaction and do tell our peers about this transaction so that they have detect and terminate also.
+        }
+
+        //UID already in queue?
+        if(tq[i].uid == t->uid)
+        {
+            coolThrottle(NULL, THROTTLE_UID_QUEUED);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex5);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+            return 0; //It's not a double spend, just a repeat, don't tell our peers
+        }
+    }
+
+    //Replays skip the cooldown, has_uid() was checked unlocked so look for the uid in the queue
+    if(ir == 0 && aQueUID(t->uid) != -1)
+    {
+        coolThrottle(NULL, THROTTLE_UID_QUEUED);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex5);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        return 0;
+    }
+
+    //Next free slot from where the last one was taken, other repeats are caught by has_uid()
+    int freeindex = -1;
+    for(uint j = 0; j < MAX_TRANS_QUEUE; j++)
+    {
+        const uint i = (tq_next + j) % MAX_TRANS_QUEUE;
+        if(tq[i].amount == 0)
+        {
+            freeindex = i;
+            tq_next = i + 1;
+            break;
+        }
+    }
+
+    //if fresh transaction add at available slot
+    if(freeindex != -1)
+    {
+        memcpy(&tq[freeindex], t, sizeof(struct trans));
+        ip[freeindex] = iip;
+        ipo[freeindex] = iipo;
+        replay[freeindex] = ir;
+        delta[freeindex] = now;
+
+        if(ir == 1)
+        {
+            coolAccept(t, freeindex, now);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+            pendingAdd(t);
+            pend[freeindex] = 1;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        }
+    }
+    else
+    {
+        coolThrottle(t->from.key, THROTTLE_QUEUE_FULL);
+        // printf("Warning: QUE FULL %u\n", gQueSize());
+    }
+
+    //Success
+    if(memcmp(t->from.key, t->to.key, ECC_CURVE+1) == 0) //is auth trans
+    {
+        add_uid(crc64(0, (unsigned char*)t->from.key, ECC_CURVE+1), 1600); //1 hr for auth trans
+    }
+    else
+    {
+        add_uid(t->uid, 30); //block uid for 9 hours (there can be collisions, as such it's a temporary block)
+    }
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex5);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    return 1;
+}
+
+//pop the first living transaction index off the Queue
+int gQue()
+{
+    const uint mi = qRand(3, MAX_TRANS_QUEUE-3);
+    for(int i = mi; i >= 0; i--) //Check left first, que is stacked left to right
+    {
+        if(i < 0 || i >= MAX_TRANS_QUEUE) //just being sure
+            break;
+
+        if(tq[i].amount != 0)
+            if(time(0) - delta[i] >= SENDER_COOLDOWN || replay[i] == 0) //Only process transactions more than 3 second old [replays are instant]
+                return i;
+    }
+    for(int i = mi; i < MAX_TRANS_QUEUE; i++) //now check to the right of random index
+    {
+        if(i < 0 || i >= MAX_TRANS_QUEUE) //just being sure
+            break;
+
+        if(tq[i].amount != 0)
+            if(time(0) - delta[i] >= SENDER_COOLDOWN || replay[i] == 0) //Only process transactions more than 3 second old [replays are instant]
+                return i;
+    }
+    return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Event Log
+
+    With `events 1` in vfc.cnf every transaction applied to the ledger is also
+    appended to .vfc/events.log with the balances it left the two addresses
+    at, see events.h for the layout and the reader. Consumers resume from an
+    event number instead of a byte offset into blocks.dat, so a rewrite of the
+    chain does not move what they have read.
+
+    On startup the log is checked against blocks.dat, a torn tail is dropped
+    and if the chain no longer holds the records the last events describe a
+    REWIND to the newest height it still agrees with is appended. The ledger
+    build then logs the records after it. The log is flushed to disk by the
+    general thread every few seconds.
+
+    eventsInit() - Open the log and line it up with the chain (node only)
+    eventsApply() - Log a transaction applied to the ledger (caller locks mutex7)
+    eventsSync() - Flush the log to disk
+    eventsStop() - Flush and close the log
+
+*/
+
+uint events_on = 0;                         //Keep the event log
+int events_fd = -1;
+struct vfc_events_head* events_head = NULL; //header page, the count is published through it
+size_t events_height = 0;                   //Chain height after the last event
+
+static uint64_t eventCRC(const struct vfc_event* e)
+{
+    struct vfc_event c;
+    memcpy(&c, e, sizeof(struct vfc_event));
+    c.crc = 0;
+    return crc64(0, (const unsigned char*)&c, sizeof(struct vfc_event));
+}
+
+static void eventsWrite(const uint32_t type, const struct trans* t, const int64_t from_bal, const int64_t to_bal, const size_t height)
+{
+    struct vfc_event e;
+    memset(&e, 0, sizeof(struct vfc_event));
+    e.seq = events_head->count;
+    e.type = type;
+    e.when = time(0);
+    e.height = height;
+    if(t != NULL)
+    {
+        e.from_bal = from_bal;
+        e.to_bal = to_bal;
+        e.uid = t->uid;
+        memcpy(e.from, t->from.key, ECC_CURVE+1);
+        memcpy(e.to, t->to.key, ECC_CURVE+1);
+        e.amount = t->amount;
+        memcpy(e.sig, t->owner.key, ECC_CURVE*2);
+    }
+    e.crc = eventCRC(&e);
+
+    if(pwrite(events_fd, &e, sizeof(struct vfc_event), EVENTS_HEAD + e.seq*sizeof(struct vfc_event)) != sizeof(struct vfc_event))
+    {
+        printf("ERROR: unable to write '%s', the event log has stopped.\n", EVENTS_FILE);
+        err++;
+        munmap(events_head, EVENTS_HEAD);
+        events_head = NULL;
+        close(events_fd);
+        events_fd = -1;
+        return;
+    }
+
+    __atomic_store_n(&events_head->count, e.seq+1, __ATOMIC_RELEASE);
+    events_height = height;
+}
+
+void eventsApply(const struct trans* t, const int64_t from_bal, const int64_t to_bal, const size_t height)
+{
+    if(events_fd == -1 || height <= events_height)
+        return;
+
+    //Records that were never logged, the consumer has to take them from blocks.dat
+    if(height-1 != events_height)
+        eventsWrite(EVENT_BASE, NULL, 0, 0, height-1);
+    if(events_fd != -1)
+        eventsWrite(EVENT_COMMIT, t, from_bal, to_bal, height);
+}
+
+void eventsInit()
+{
+    if(events_on == 0)
+        return;
+
+    events_fd = open(EVENTS_FILE, O_RDWR | O_CREAT, 0644);
+    if(events_fd == -1)
+    {
+        printf("ERROR: Could not open %s, the event log is disabled.\n", EVENTS_FILE);
+        err++;
+        return;
+    }
+
+    size_t len = lseek(events_fd, 0, SEEK_END);
+    if(len < EVENTS_HEAD && ftruncate(events_fd, EVENTS_HEAD) == 0)
+        len = EVENTS_HEAD;
+    events_head = mmap(NULL, EVENTS_HEAD, PROT_READ | PROT_WRITE, MAP_SHARED, events_fd, 0);
+    if(len < EVENTS_HEAD || events_head == MAP_FAILED)
+    {
+        printf("ERROR: Could not map %s, the event log is disabled.\n", EVENTS_FILE);
+        err++;
+        events_head = NULL;
+        close(events_fd);
+        events_fd = -1;
+        return;
+    }
+
+    //New or foreign file, start over
+    if(events_head->magic != EVENTS_MAGIC || events_head->esize != sizeof(struct vfc_event))
+    {
+        memset(events_head, 0, EVENTS_HEAD);
+        events_head->magic = EVENTS_MAGIC;
+        events_head->esize = sizeof(struct vfc_event);
+        len = EVENTS_HEAD;
+    }
+
+    //Drop a torn tail, the count and the events may have reached the disk in either order
+    struct vfc_event e;
+    uint64_t n = (len - EVENTS_HEAD) / sizeof(struct vfc_event);
+    while(n > 0 && (pread(events_fd, &e, sizeof(struct vfc_event), EVENTS_HEAD + (n-1)*sizeof(struct vfc_event)) != sizeof(struct vfc_event) || e.seq != n-1 || e.crc != eventCRC(&e)))
+        n--;
+    if(ftruncate(events_fd, EVENTS_HEAD + n*sizeof(struct vfc_event)) != 0)
+    {
+        printf("ERROR: ftruncate() in eventsInit() has failed.\n");
+        err++;
+    }
+    events_head->count = n;
+
+    const size_t height = getChainSize() / sizeof(struct trans);
+    if(n == 0)
+    {
+        events_height = height;
+        eventsWrite(EVENT_BASE, NULL, 0, 0, height);
+        return;
+    }
+
+    //The newest event blocks.dat still agrees with
+    int f = open(CHAIN_FILE, O_RDONLY);
+    size_t last = 0, agreed = 0;
+    for(uint64_t i = n; i > 0; i--)
+    {
+        if(pread(events_fd, &e, sizeof(struct vfc_event), EVENTS_HEAD + (i-1)*sizeof(struct vfc_event)) != sizeof(struct vfc_event))
+            break;
+        if(i == n)
+            last = e.height;
+        if(e.height > height)
+            continue;
+        if(e.type != EVENT_COMMIT)
+        {
+            agreed = e.height;
+            break;
+        }
+
+        struct trans t;
+        if(f != -1 && pread(f, &t, sizeof(struct trans), (e.height-1)*sizeof(struct trans)) == sizeof(struct trans) &&
+            t.uid == e.uid && t.amount == e.amount && memcmp(t.from.key, e.from, ECC_CURVE+1) == 0 && memcmp(t.to.key, e.to, ECC_CURVE+1) == 0 && memcmp(t.owner.key, e.sig, ECC_CURVE*2) == 0)
+        {
+            agreed = e.height;
+            break;
+        }
+    }
+    if(f != -1)
+        close(f);
+
+    events_height = last;
+    if(agreed != last)
+        eventsWrite(EVENT_REWIND, NULL, 0, 0, agreed);
+}
+
+void eventsSync()
+{
+    if(events_fd != -1)
+        fdatasync(events_fd);
+}
+
+void eventsStop()
+{
+    if(events_fd == -1)
+        return;
+    eventsSync();
+    munmap(events_head, EVENTS_HEAD);
+    events_head = NULL;
+    close(events_fd);
+    events_fd = -1;
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Ledger
+
+    The running node keeps the chain balance of every address in memory so
+    that hasbalance() does not have to walk blocks.dat for each transaction.
+    It is built once at startup and advanced by every append in process_trans().
+
+    The stored balance excludes the subG value, isSubGenesisAddress() depends on
+    the network difficulty and chain height so it is added at query time.
+
+    The supply accumulators carry the per-record terms of getMinedSupply() and
+    getCirculatingSupply(), the inflation tax is added from the height on demand.
+
+    ledgerInit() - Build the ledger from the chain file
+    ledgerApply() - Apply a transaction to the ledger (caller locks mutex7)
+    ledgerBalance() - Chain balance of an address (caller locks mutex7)
+    supplyApply() - Add a transaction to a pair of supply accumulators
+
+*/
+
+struct lent //ledger entry
+{
+    addr key;
+    uint8_t used;
+    int64_t bal; //sum of received minus sent
+};
+
+struct amap ledger;
+size_t ledger_height = 0;   //Transactions applied to the ledger
+uint ledger_ready = 0;      //Only the running node has a ledger
+uint64_t ledger_minted = 0; //Sum of the subG values paid out
+uint64_t ledger_circ = 0;   //Circulating supply excluding the inflation tax
+
+void supplyApply(const struct trans* t, uint64_t* minted, uint64_t* circ)
+{
+    //Difficulty burning addresses
+    static uint8_t lpub[ECC_CURVE+1], tpub[ECC_CURVE+1];
+    static uint vinit = 0;
+    if(vinit == 0)
+    {
+        size_t len = ECC_CURVE+1;
+        b58tobin(lpub, &len, "q15voteVFCf7Csb8dKwaYkcYVEWa2CxJVHm96SGEpvzK", 44);
+        len = ECC_CURVE+1;
+        b58tobin(tpub, &len, "24KvoteVFC7JsTiFaGna9F6RhtMWdB7MUa3wZoVNm7wH3", 45);
+        vinit = 1;
+    }
+
+    //Negate payments to difficulty burn addresses
+    if(memcmp(t->to.key, lpub, ECC_CURVE+1) == 0 || memcmp(t->to.key, tpub, ECC_CURVE+1) == 0)
+        *circ -= t->amount;
+
+    //All the paid out subG address values, and the transactions leaving the genesis key
+    if(memcmp(t->from.key, genesis_pub, ECC_CURVE+1) != 0)
+    {
+        const uint64_t w = isSubGenesisAddress((uint8_t*)t->from.key, 1);
+        *minted += w;
+        *circ += w;
+    }
+    else
+    {
+        *circ += t->amount;
+    }
+}
+
+void ledgerApply(const struct trans* t)
+{
+    //Same precedence as the chain scans, a transaction to self is counted as received
+    struct lent* e = amap_put(&ledger, t->to.key);
+    e->bal += t->amount;
+
+    if(memcmp(t->from.key, t->to.key, ECC_CURVE+1) != 0)
+    {
+        e = amap_put(&ledger, t->from.key);
+        e->bal -= t->amount;
+    }
+
+    supplyApply(t, &ledger_minted, &ledger_circ);
+    ledger_height++;
+
+    chain_digest += recordDigest(t);
+    chain_digest_height = ledger_height;
+
+    //Log it with the balances it left both addresses at
+    if(events_fd != -1)
+        eventsApply(t, ((struct lent*)amap_get(&ledger, t->from.key))->bal, ((struct lent*)amap_get(&ledger, t->to.key))->bal, ledger_height);
+}
+
+int64_t ledgerBalance(const addr* a)
+{
+    const struct lent* e = amap_get(&ledger, a->key);
+    if(e == NULL)
+        return 0;
+    return e->bal;
+}
+
+void ledgerInit()
+{
+    amap_init(&ledger, sizeof(struct lent), 65536);
+    ledger_height = 0;
+    ledger_minted = 0;
+    ledger_circ = 0;
+    chain_digest = 0;
+    chain_digest_height = 0;
+
+    int f = open(CHAIN_FILE, O_RDONLY);
+    if(f != -1)
+    {
+        const size_t len = lseek(f, 0, SEEK_END);
+
+        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
+        if(m != MAP_FAILED)
+        {
+            struct trans t;
+            for(size_t i = 0; i+sizeof(struct trans) <= len; i += sizeof(struct trans))
+            {
+                memcpy(&t, m+i, sizeof(struct trans));
+                ledgerApply(&t);
+            }
+
+            munmap(m, len);
+        }
+
+        close(f);
+    }
+
+    ledger_ready = 1;
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Ledger Replica
+
+    The node mirrors the ledger into .vfc/ledger.shm, a shared mapping laid out
+    in replica.h, so external readers get balances without a process spawn or
+    a chain scan. Every ledger update is repeated in the replica inside a
+    sequence lock, the table is rebuilt from the ledger when it runs out of
+    room and the old mapping is retired so readers reopen it.
+
+    replicaInit() - Publish the replica from the ledger (node only)
+    replicaApply() - Mirror a transaction applied to the ledger (caller locks mutex7)
+    replicaStop() - Mark the replica as no longer maintained
+    replicaBeat() - Refresh the heartbeat readers check the replica by (node only, locks mutex7)
+    replicaLookup() - Chain balance from the replica of a running node, used by the CLI
+
+*/
+
+struct replica_head* replica = NULL;
+size_t replica_len = 0;
+
+static void replicaPut(struct replica_head* h, const uint8_t* key, const int64_t bal)
+{
+    struct replica_slot* s = (struct replica_slot*)(h+1);
+    const uint64_t mask = h->cap - 1;
+    for(uint64_t i = replicaHash(h->salt, key) & mask;; i = (i+1) & mask)
+    {
+        if(s[i].used == 0)
+        {
+            memcpy(s[i].key, key, REPLICA_KEY);
+            s[i].bal = bal;
+            s[i].used = 1;
+            h->num++;
+            return;
+        }
+        if(memcmp(s[i].key, key, REPLICA_KEY) == 0)
+        {
+            s[i].bal = bal;
+            return;
+        }
+    }
+}
+
+//Retire the current mapping, readers see the magic go and reopen
+static void replicaRetire()
+{
+    if(replica == NULL)
+        return;
+    __atomic_store_n(&replica->magic, 0, __ATOMIC_RELEASE);
+    munmap(replica, replica_len);
+    replica = NULL;
+    replica_len = 0;
+}
+
+//Caller locks mutex7 once the node is running
+void replicaInit()
+{
+    //Room for the ledger to double before the next rebuild
+    uint64_t cap = 65536;
+    while(cap < ledger.num*4)
+        cap <<= 1;
+    const size_t len = sizeof(struct replica_head) + cap*sizeof(struct replica_slot);
+
+    int f = open(REPLICA_FILE ".tmp", O_RDWR|O_CREAT|O_TRUNC, 0644);
+    if(f == -1 || ftruncate(f, len) == -1)
+    {
+        printf("ERROR: unable to create '%s'.\n", REPLICA_FILE ".tmp");
+        err++;
+        if(f != -1)
+            close(f);
+        replicaRetire();
+        return;
+    }
+
+    struct replica_head* h = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, f, 0);
+    close(f);
+    if(h == MAP_FAILED)
+    {
+        replicaRetire();
+        return;
+    }
+
+    h->cap = cap;
+    h->salt = ledger.salt;
+    for(size_t i = 0; i < ledger.cap; i++)
+    {
+        const struct lent* l = (const struct lent*)(ledger.e + i*ledger.esize);
+        if(l->used != 0)
+            replicaPut(h, l->key.key, l->bal);
+    }
+    h->height = ledger_height;
+    h->minted = ledger_minted;
+    h->circ = ledger_circ;
+    h->beat = time(0);
+    h->pid = getpid();
+    __atomic_store_n(&h->magic, REPLICA_MAGIC, __ATOMIC_RELEASE);
+
+    if(rename(REPLICA_FILE ".tmp", REPLICA_FILE) == -1)
+    {
+        printf("ERROR: rename() in replicaInit() has failed.\n");
+        err++;
+        munmap(h, len);
+        replicaRetire();
+        return;
+    }
+
+    replicaRetire();
+    replica = h;
+    replica_len = len;
+}
+
+void replicaApply(const struct trans* t)
+{
+    if(replica == NULL)
+        return;
+
+    //Grow at 70% load
+    if((replica->num+2)*10 > replica->cap*7)
+    {
+        replicaInit();
+        return;
+    }
+
+    const uint64_t seq = replica->seq;
+    __atomic_store_n(&replica->seq, seq+1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    replicaPut(replica, t->to.key, ledgerBalance(&t->to));
+    replicaPut(replica, t->from.key, ledgerBalance(&t->from));
+    replica->height = ledger_height;
+    replica->minted = ledger_minted;
+    replica->circ = ledger_circ;
+
+    __atomic_store_n(&replica->seq, seq+2, __ATOMIC_RELEASE);
+}
+
+void replicaStop()
+{
+    if(replica != NULL)
+        __atomic_store_n(&replica->pid, 0, __ATOMIC_RELEASE);
+}
+
+void replicaBeat()
+{
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    if(replica != NULL)
+        __atomic_store_n(&replica->beat, (uint64_t)time(0), __ATOMIC_RELEASE);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+}
+
+//1 with the chain balance and height, 0 when no running node maintains a replica
+uint replicaLookup(const addr* a, int64_t* bal, uint64_t* height)
+{
+    struct vfc_replica r;
+    if(replicaOpen(&r, REPLICA_FILE) == 0)
+        return 0;
+
+    const uint ok = replicaBalance(&r, a->key, bal, height) == 1;
+    replicaClose(&r);
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ UID Index
+
+    An open addressing hash table (uid -> record number) stored in .vfc/uid.idx
+    and mapped into memory, so a UID lookup is a single probe instead of a walk
+    of blocks.dat. The node keeps it in sync from process_trans(), anything else
+    opens it read-only and scans only the records after the indexed height.
+
+    The header records the indexed height and a crc64 of the last indexed record
+    so a truncated or replaced chain is detected, and a clean flag which is only
+    set on a graceful shutdown. Where more than one record shares a UID the first
+    occurrence is kept, that is the record a chain scan would find. On a pruned
+    chain the UIDs of the released records are rebuilt from .vfc/pruned.uid,
+    the node won't start without them.
+
+    uidxOpen() - Map the index, writable for the node or read-only and validated against the chain
+    uidxClose() - Unmap the index, the node flushes it and marks it clean
+    uidxBuild() - Rebuild the index from the chain file
+    uidxFind() - Record number of a UID or -1
+    uidxHas() - UID lookup for the node (locks mutex8), -1 without an index
+    uidxAppend() - Index a record appended to the chain (caller locks mutex8)
+    uidxInit() - Open or rebuild the index and catch up with the chain, used by the node
+
+*/
+
+#define UIDX_MAGIC 0x3130786469756676 //"vfuidx01"
+
+struct uidx_head
+{
+    uint64_t magic;
+    uint64_t cap;       //number of slots, a power of two
+    uint64_t num;       //used slots
+    uint64_t height;    //chain records indexed
+    uint64_t tail;      //crc64 of the last indexed record
+    uint64_t salt;
+    uint64_t clean;     //1 when the node closed the index gracefully
+    uint64_t reserved;
+};
+
+struct uidx_slot
+{
+    uint64_t uid;
+    uint64_t rec;       //record number + 1, zero is an empty slot
+};
+
+struct uidx_head* uidx = NULL;
+size_t uidx_len = 0;
+uint uidx_write = 0;
+
+inline static uint64_t uidHash(const uint64_t salt, uint64_t x)
+{
+    x ^= salt;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+inline static struct uidx_slot* uidxSlots()
+{
+    return (struct uidx_slot*)(uidx+1);
+}
+
+uint64_t recordCRC(const struct trans* t)
+{
+    return crc64(0, (const unsigned char*)t, sizeof(struct trans));
+}
+
+//Is the record at height-1 still the one an index was built up to
+uint chainHasTail(const size_t height, const uint64_t tail)
+{
+    if(height == 0)
+        return 1;
+
+    uint valid = 0;
+    int f = open(CHAIN_FILE, O_RDONLY);
+    if(f != -1)
+    {
+        struct trans t;
+        if(height <= lseek(f, 0, SEEK_END) / sizeof(struct trans))
+            if(pread(f, &t, sizeof(struct trans), (height-1) * sizeof(struct trans)) == sizeof(struct trans))
+                if(recordCRC(&t) == tail)
+                    valid = 1;
+
+        close(f);
+    }
+
+    return valid;
+}
+
+void uidxClose()
+{
+    if(uidx == NULL)
+        return;
+
+    if(uidx_write == 1)
+    {
+        msync(uidx, uidx_len, MS_SYNC);
+        uidx->clean = 1;
+        msync(uidx, sizeof(struct uidx_head), MS_SYNC);
+    }
+
+    munmap(uidx, uidx_len);
+    uidx = NULL;
+    uidx_len = 0;
+    uidx_write = 0;
+}
+
+uint uidxOpen(const uint write)
+{
+    uidxClose();
+
+    int f = open(UIDX_FILE, write == 1 ? O_RDWR : O_RDONLY);
+    if(f == -1)
+        return 0;
+
+    const size_t len = lseek(f, 0, SEEK_END);
+    if(len < sizeof(struct uidx_head))
+    {
+        close(f);
+        return 0;
+    }
+
+    struct uidx_head* m = mmap(NULL, len, write == 1 ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, f, 0);
+    close(f);
+    if(m == MAP_FAILED)
+        return 0;
+
+    if(m->magic != UIDX_MAGIC || m->cap == 0 || (m->cap & (m->cap-1)) != 0 || len != sizeof(struct uidx_head) + m->cap*sizeof(struct uidx_slot))
+    {
+        munmap(m, len);
+        return 0;
+    }
+
+    //Does the chain still contain what was indexed?
+    if(chainHasTail(m->height, m->tail) == 0)
+    {
+        munmap(m, len);
+        return 0;
+    }
+
+    uidx = m;
+    uidx_len = len;
+    uidx_write = write;
+    return 1;
+}
+
+int64_t uidxFind(const uint64_t uid)
+{
+    if(uidx == NULL)
+        return -1;
+
+    const uint64_t mask = uidx->cap - 1;
+    struct uidx_slot* s = uidxSlots();
+    uint64_t i = uidHash(uidx->salt, uid) & mask;
+    for(uint64_t n = 0; n < uidx->cap; n++, i = (i+1) & mask)
+    {
+        //rec is written after uid, an empty rec ends the probe
+        const uint64_t rec = s[i].rec;
+        if(rec == 0)
+            return -1;
+        __sync_synchronize();
+        if(s[i].uid == uid)
+            return rec-1;
+    }
+
+    return -1;
+}
+
+//Used by the node, -1 when there is no index to answer from
+int uidxHas(const uint64_t uid)
+{
+    int r = -1;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    if(uidx != NULL)
+        r = uidxFind(uid) != -1;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    return r;
+}
+
+static void uidxInsert(struct uidx_head* h, const uint64_t uid, const uint64_t rec)
+{
+    const uint64_t mask = h->cap - 1;
+    struct uidx_slot* s = (struct uidx_slot*)(h+1);
+    for(uint64_t i = uidHash(h->salt, uid) & mask;; i = (i+1) & mask)
+    {
+        if(s[i].rec == 0)
+        {
+            s[i].uid = uid;
+            __sync_synchronize();
+            s[i].rec = rec+1;
+            h->num++;
+            return;
+        }
+
+        if(s[i].uid == uid) //first occurrence wins
+            return;
+    }
+}
+
+//Index the UIDs of the records a pruned chain released, 0 if pruned.uid doesn't hold them all
+static uint uidxPruned(struct uidx_head* h)
+{
+    const int f = open(PRUNED_UID_FILE, O_RDONLY);
+    if(f == -1)
+        return 0;
+    if((size_t)lseek(f, 0, SEEK_END) < chain_pruned*sizeof(uint64_t))
+    {
+        close(f);
+        return 0;
+    }
+
+    uint64_t u[4096];
+    for(size_t i = 0; i < chain_pruned;)
+    {
+        const size_t n = chain_pruned - i < 4096 ? chain_pruned - i : 4096;
+        if(pread(f, u, n*sizeof(uint64_t), i*sizeof(uint64_t)) != (ssize_t)(n*sizeof(uint64_t)))
+        {
+            close(f);
+            return 0;
+        }
+        for(size_t j = 0; j < n; j++)
+            uidxInsert(h, u[j], i+j);
+        i += n;
+    }
+
+    close(f);
+    return 1;
+}
+
+uint uidxBuild(uint64_t cap)
+{
+    int f = open(CHAIN_FILE, O_RDONLY);
+    if(f == -1)
+        return 0;
+
+    const size_t len = lseek(f, 0, SEEK_END);
+    const size_t height = len / sizeof(struct trans);
+
+    //Keep the load under 50% after a rebuild
+    if(cap < 65536)
+        cap = 65536;
+    while(cap < height*2)
+        cap <<= 1;
+    const size_t ilen = sizeof(struct uidx_head) + cap*sizeof(struct uidx_slot);
+
+    int fi = open(UIDX_FILE ".tmp", O_RDWR|O_CREAT|O_TRUNC, 0644);
+    if(fi == -1 || ftruncate(fi, ilen) == -1)
+    {
+        printf("ERROR: unable to create '%s'.\n", UIDX_FILE ".tmp");
+        err++;
+        if(fi != -1)
+            close(fi);
+        close(f);
+        return 0;
+    }
+
+    struct uidx_head* h = mmap(NULL, ilen, PROT_READ|PROT_WRITE, MAP_SHARED, fi, 0);
+    close(fi);
+    if(h == MAP_FAILED)
+    {
+        close(f);
+        return 0;
+    }
+
+    h->cap = cap;
+    h->salt = uidHash(time(0), (uint64_t)getpid() ^ (uint64_t)(size_t)h);
+
+    //A pruned chain's released UIDs come from pruned.uid
+    if(chain_pruned != 0 && uidxPruned(h) == 0)
+    {
+        munmap(h, ilen);
+        unlink(UIDX_FILE ".tmp");
+        close(f);
+        return 0;
+    }
+
+    if(len > 0)
+    {
+        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
+        if(m != MAP_FAILED)
+        {
+            struct trans t;
+            for(size_t i = chain_pruned; i < height; i++)
+            {
+                memcpy(&t, m + i*sizeof(struct trans), sizeof(struct trans));
+                uidxInsert(h, t.uid, i);
+                h->tail = recordCRC(&t);
+                h->height = i+1;
+            }
+
+            munmap(m, len);
+        }
+    }
+    close(f);
+
+    //Publish
+    h->clean = 1;
+    h->magic = UIDX_MAGIC;
+    msync(h, ilen, MS_SYNC);
+    munmap(h, ilen);
+    if(rename(UIDX_FILE ".tmp", UIDX_FILE) == -1)
+    {
+        printf("ERROR: rename() in uidxBuild() has failed.\n");
+        err++;
+        return 0;
+    }
+
+    return 1;
+}
+
+//Rehash the open index into a larger one, the chain may no longer hold every UID
+static uint uidxGrow(const uint64_t cap)
+{
+    const size_t ilen = sizeof(struct uidx_head) + cap*sizeof(struct uidx_slot);
+
+    int fi = open(UIDX_FILE ".tmp", O_RDWR|O_CREAT|O_TRUNC, 0644);
+    if(fi == -1 || ftruncate(fi, ilen) == -1)
+    {
+        printf("ERROR: unable to create '%s'.\n", UIDX_FILE ".tmp");
+        err++;
+        if(fi != -1)
+            close(fi);
+        return 0;
+    }
+
+    struct uidx_head* h = mmap(NULL, ilen, PROT_READ|PROT_WRITE, MAP_SHARED, fi, 0);
+    close(fi);
+    if(h == MAP_FAILED)
+        return 0;
+
+    h->cap = cap;
+    h->salt = uidx->salt;
+    const struct uidx_slot* s = uidxSlots();
+    for(uint64_t i = 0; i < uidx->cap; i++)
+        if(s[i].rec != 0)
+            uidxInsert(h, s[i].uid, s[i].rec-1);
+    h->height = uidx->height;
+    h->tail = uidx->tail;
+
+    //Publish
+    h->clean = 1;
+    h->magic = UIDX_MAGIC;
+    msync(h, ilen, MS_SYNC);
+    munmap(h, ilen);
+    if(rename(UIDX_FILE ".tmp", UIDX_FILE) == -1)
+    {
+        printf("ERROR: rename() in uidxGrow() has failed.\n");
+        err++;
+        return 0;
+    }
+
+    return 1;
+}
+
+void uidxAppend(const struct trans* t, const size_t rec)
+{
+    if(uidx == NULL || rec < uidx->height)
+        return;
+
+    //Grow at 70% load
+    if((uidx->num+1)*10 > uidx->cap*7)
+    {
+        const uint grown = uidxGrow(uidx->cap*2);
+        uidxClose();
+        if(grown == 0 || uidxOpen(1) == 0)
+        {
+            printf("ERROR: the UID index could not be grown, falling back to chain scans.\n");
+            err++;
+            return;
+        }
+        uidx->clean = 0;
+    }
+
+    uidxInsert(uidx, t->uid, rec);
+    uidx->tail = recordCRC(t);
+    __sync_synchronize();
+    uidx->height = rec+1;
+}
+
+void uidxInit()
+{
+    if(uidxOpen(1) == 0 || uidx->clean == 0)
+    {
+        uidxClose();
+        if(uidxBuild(0) == 0 || uidxOpen(1) == 0)
+        {
+            //Without the UIDs a pruned chain released an index would accept them again
+            if(chain_pruned != 0)
+            {
+                printf("ERROR: blocks.dat has been pruned and '%s' can't be rebuilt, '%s' does not hold the released UIDs.\n", UIDX_FILE, PRUNED_UID_FILE);
+                printf("Restore the index, or the full blocks.dat without '%s' and run `vfc reindex`.\n", PRUNED_FILE);
+                exit(0);
+            }
+            return;
+        }
+    }
+    uidx->clean = 0;
+
+    //Catch up with records appended since the index was last written
+    int f = open(CHAIN_FILE, O_RDONLY);
+    if(f != -1)
+    {
+        const size_t height = lseek(f, 0, SEEK_END) / sizeof(struct trans);
+        struct trans t;
+        for(size_t i = uidx->height; i < height && uidx != NULL; i++)
+            if(pread(f, &t, sizeof(struct trans), i*sizeof(struct trans)) == sizeof(struct trans))
+                uidxAppend(&t, i);
+        close(f);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Address Index
+
+    Posting lists of the records each address appears in, so the history of an
+    address costs O(history) rather than a walk of blocks.dat.
+
+    .vfc/addr.idx is an open addressing table (address -> newest posting, count)
+    mapped into memory, .vfc/addr.pst holds the postings as a linked list per
+    address from the newest record back to the oldest. A record is posted once
+    for its recipient and once for its sender when they differ. The header is
+    validated against the chain the same way as the UID index and the postings
+    file carries the salt of the table it belongs to.
+
+    aidxOpen() - Map the index, writable for the node or read-only and validated against the chain
+    aidxClose() - Unmap the index, the node flushes it and marks it clean
+    aidxBuild() - Rebuild the index and postings from the chain file
+    aidxAppend() - Index a record appended to the chain (caller locks mutex8)
+    aidxInit() - Open or rebuild the index and catch up with the chain, used by the node
+
+    ahistOpen() - Records of an address in chain order, followed by the chain tail the index has not seen
+    ahistNext() - Byte offset of the next record to look at, or the chain length when done
+    ahistClose() - Free the history
+
+*/
+
+#define AIDX_MAGIC 0x3130786469616676 //"vfaidx01"
+
+struct aidx_head
+{
+    uint64_t magic;
+    uint64_t cap;       //number of slots, a power of two
+    uint64_t num;       //used slots
+    uint64_t height;    //chain records indexed
+    uint64_t tail;      //crc64 of the last indexed record
+    uint64_t salt;
+    uint64_t clean;     //1 when the node closed the index gracefully
+    uint64_t nodes;     //postings written
+};
+
+struct aidx_slot
+{
+    addr key;
+    uint8_t pad[7];
+    uint64_t head;      //newest posting + 1, zero is an empty slot
+    uint64_t count;     //postings of this address
+};
+
+struct apst
+{
+    uint64_t rec;       //record number
+    uint64_t prev;      //previous posting + 1 of the same address, zero ends the list
+};
+
+struct aidx_head* aidx = NULL;
+size_t aidx_len = 0;
+uint aidx_write = 0;
+int apst_fd = -1;
+
+inline static struct aidx_slot* aidxSlots(const struct aidx_head* h)
+{
+    return (struct aidx_slot*)(h+1);
+}
+
+inline static size_t aidxSize(const uint64_t cap)
+{
+    return sizeof(struct aidx_head) + cap*sizeof(struct aidx_slot);
+}
+
+void aidxClose()
+{
+    if(aidx == NULL)
+        return;
+
+    if(aidx_write == 1)
+    {
+        fdatasync(apst_fd);
+        msync(aidx, aidx_len, MS_SYNC);
+        aidx->clean = 1;
+        msync(aidx, sizeof(struct aidx_head), MS_SYNC);
+    }
+
+    close(apst_fd);
+    apst_fd = -1;
+    munmap(aidx, aidx_len);
+    aidx = NULL;
+    aidx_len = 0;
+    aidx_write = 0;
+}
+
+uint aidxOpen(const uint write)
+{
+    aidxClose();
+
+    int f = open(AIDX_FILE, write == 1 ? O_RDWR : O_RDONLY);
+    if(f == -1)
+        return 0;
+
+    const size_t len = lseek(f, 0, SEEK_END);
+    if(len < sizeof(struct aidx_head))
+    {
+        close(f);
+        return 0;
+    }
+
+    struct aidx_head* m = mmap(NULL, len, write == 1 ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, f, 0);
+    close(f);
+    if(m == MAP_FAILED)
+        return 0;
+
+    if(m->magic != AIDX_MAGIC || m->cap == 0 || (m->cap & (m->cap-1)) != 0 || len != aidxSize(m->cap))
+    {
+        munmap(m, len);
+        return 0;
+    }
+
+    //The postings must belong to this table
+    f = open(APST_FILE, write == 1 ? O_RDWR : O_RDONLY);
+    uint64_t ph[2] = {0};
+    if(f == -1 || pread(f, ph, sizeof(ph), 0) != sizeof(ph) || ph[0] != AIDX_MAGIC || ph[1] != m->salt ||
+        (size_t)lseek(f, 0, SEEK_END) < sizeof(ph) + m->nodes*sizeof(struct apst))
+    {
+        if(f != -1)
+            close(f);
+        munmap(m, len);
+        return 0;
+    }
+
+    //Does the chain still contain what was indexed?
+    if(chainHasTail(m->height, m->tail) == 0)
+    {
+        close(f);
+        munmap(m, len);
+        return 0;
+    }
+
+    aidx = m;
+    aidx_len = len;
+    aidx_write = write;
+    apst_fd = f;
+    return 1;
+}
+
+struct aidx_slot* aidxFind(const struct aidx_head* h, const uint8_t* key)
+{
+    const uint64_t mask = h->cap - 1;
+    struct aidx_slot* s = aidxSlots(h);
+    uint64_t i = addrHash(h->salt, key) & mask;
+    for(uint64_t n = 0; n < h->cap; n++, i = (i+1) & mask)
+    {
+        //head is written after the key, an empty head ends the probe
+        if(s[i].head == 0)
+            return NULL;
+        __sync_synchronize();
+        if(memcmp(s[i].key.key, key, ECC_CURVE+1) == 0)
+            return &s[i];
+    }
+
+    return NULL;
+}
+
+static struct aidx_slot* aidxPut(struct aidx_head* h, const uint8_t* key)
+{
+    const uint64_t mask = h->cap - 1;
+    struct aidx_slot* s = aidxSlots(h);
+    for(uint64_t i = addrHash(h->salt, key) & mask;; i = (i+1) & mask)
+    {
+        if(s[i].head == 0)
+        {
+            memcpy(s[i].key.key, key, ECC_CURVE+1);
+            h->num++;
+            return &s[i];
+        }
+
+        if(memcmp(s[i].key.key, key, ECC_CURVE+1) == 0)
+            return &s[i];
+    }
+}
+
+//Copy the slots of one table into an empty one of another size
+static void aidxRehash(const struct aidx_head* src, struct aidx_head* dst)
+{
+    dst->salt = src->salt;
+    dst->height = src->height;
+    dst->tail = src->tail;
+    dst->nodes = src->nodes;
+
+    const struct aidx_slot* s = aidxSlots(src);
+    for(uint64_t i = 0; i < src->cap; i++)
+    {
+        if(s[i].head == 0)
+            continue;
+
+        struct aidx_slot* d = aidxPut(dst, s[i].key.key);
+        d->count = s[i].count;
+        d->head = s[i].head;
+    }
+}
+
+//Write a table to the index file, the postings already have to be in place
+static uint aidxWrite(const struct aidx_head* h, const uint64_t clean)
+{
+    const size_t len = aidxSize(h->cap);
+    int f = open(AIDX_FILE ".tmp", O_RDWR|O_CREAT|O_TRUNC, 0644);
+    if(f == -1 || ftruncate(f, len) == -1)
+    {
+        printf("ERROR: unable to create '%s'.\n", AIDX_FILE ".tmp");
+        err++;
+        if(f != -1)
+            close(f);
+        return 0;
+    }
+
+    struct aidx_head* m = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, f, 0);
+    close(f);
+    if(m == MAP_FAILED)
+        return 0;
+
+    memcpy(m, h, len);
+    m->clean = clean;
+    m->magic = AIDX_MAGIC;
+    msync(m, len, MS_SYNC);
+    munmap(m, len);
+
+    if(rename(AIDX_FILE ".tmp", AIDX_FILE) == -1)
+    {
+        printf("ERROR: rename() in aidxWrite() has failed.\n");
+        err++;
+        return 0;
+    }
+
+    return 1;
+}
+
+//Double the table in memory
+static struct aidx_head* aidxGrow(struct aidx_head* h)
+{
+    struct aidx_head* n = calloc(1, aidxSize(h->cap*2));
+    if(n == NULL)
+        return NULL;
+    n->cap = h->cap*2;
+    aidxRehash(h, n);
+    return n;
+}
+
+static void aidxPost(struct aidx_head* h, struct apst* p, const uint8_t* key, const uint64_t rec)
+{
+    struct aidx_slot* s = aidxPut(h, key);
+    p->rec = rec;
+    p->prev = s->head;
+    h->nodes++;
+    s->count++;
+    __sync_synchronize();
+    s->head = h->nodes;
+}
+
+uint aidxBuild()
+{
+    int f = open(CHAIN_FILE, O_RDONLY);
+    if(f == -1)
+        return 0;
+
+    const size_t len = lseek(f, 0, SEEK_END);
+    const size_t height = len / sizeof(struct trans);
+
+    struct aidx_head* h = calloc(1, aidxSize(65536));
+    FILE* fp = fopen(APST_FILE ".tmp", "w");
+    if(h == NULL || fp == NULL)
+    {
+        printf("ERROR: unable to create '%s'.\n", APST_FILE ".tmp");
+        err++;
+        free(h);
+        if(fp != NULL)
+            fclose(fp);
+        close(f);
+        return 0;
+    }
+
+    h->cap = 65536;
+    h->salt = uidHash(time(0), (uint64_t)getpid() ^ (uint64_t)(size_t)h);
+    const uint64_t ph[2] = {AIDX_MAGIC, h->salt};
+    uint ok = fwrite(ph, sizeof(ph), 1, fp) == 1;
+
+    if(len > 0)
+    {
+        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
+        if(m != MAP_FAILED)
+        {
+            struct trans t;
+            struct apst p[2];
+            for(size_t i = chain_pruned; i < height && ok == 1; i++)
+            {
+                memcpy(&t, m + i*sizeof(struct trans), sizeof(struct trans));
+
+                if((h->num+2)*10 > h->cap*7)
+                {
+                    struct aidx_head* n = aidxGrow(h);
+                    free(h);
+                    h = n;
+                    if(h == NULL)
+                        break;
+                }
+
+                uint np = 1;
+                aidxPost(h, &p[0], t.to.key, i);
+                if(memcmp(t.from.key, t.to.key, ECC_CURVE+1) != 0)
+                {
+                    aidxPost(h, &p[1], t.from.key, i);
+                    np = 2;
+                }
+
+                ok = fwrite(p, sizeof(struct apst), np, fp) == np;
+                h->tail = recordCRC(&t);
+                h->height = i+1;
+            }
+
+            munmap(m, len);
+        }
+    }
+    close(f);
+
+    if(fclose(fp) != 0 || h == NULL || ok == 0)
+    {
+        printf("ERROR: unable to write '%s'.\n", APST_FILE ".tmp");
+        err++;
+        free(h);
+        return 0;
+    }
+
+    //The table is published last, it is what makes the new postings reachable
+    if(rename(APST_FILE ".tmp", APST_FILE) == -1)
+    {
+        printf("ERROR: rename() in aidxBuild() has failed.\n");
+        err++;
+        free(h);
+        return 0;
+    }
+
+    ok = aidxWrite(h, 1);
+    free(h);
+    return ok;
+}
+
+void aidxAppend(const struct trans* t, const size_t rec)
+{
+    if(aidx == NULL || rec < aidx->height)
+        return;
+
+    //Grow at 70% load, the postings stay where they are
+    if((aidx->num+2)*10 > aidx->cap*7)
+    {
+        struct aidx_head* n = aidxGrow(aidx);
+        aidxClose();
+        if(n == NULL || aidxWrite(n, 0) == 0 || aidxOpen(1) == 0)
+        {
+            printf("ERROR: the address index could not be grown, falling back to chain scans.\n");
+            err++;
+            free(n);
+            return;
+        }
+        free(n);
+    }
+
+    struct apst p;
+    const uint8_t* keys[2] = {t->to.key, t->from.key};
+    const uint np = memcmp(t->from.key, t->to.key, ECC_CURVE+1) != 0 ? 2 : 1;
+    for(uint i = 0; i < np; i++)
+    {
+        //The posting has to be on disk before the table points at it
+        struct aidx_slot* s = aidxPut(aidx, keys[i]);
+        p.rec = rec;
+        p.prev = s->head;
+        if(pwrite(apst_fd, &p, sizeof(struct apst), 2*sizeof(uint64_t) + aidx->nodes*sizeof(struct apst)) != sizeof(struct apst))
+        {
+            printf("ERROR: pwrite() in aidxAppend() has failed, falling back to chain scans.\n");
+            err++;
+            aidx->clean = 0;
+            munmap(aidx, aidx_len);
+            close(apst_fd);
+            aidx = NULL;
+            apst_fd = -1;
+            return;
+        }
+
+        aidx->nodes++;
+        s->count++;
+        __sync_synchronize();
+        s->head = aidx->nodes;
+    }
+
+    aidx->tail = recordCRC(t);
+    __sync_synchronize();
+    aidx->height = rec+1;
+}
+
+void aidxInit()
+{
+    if(aidxOpen(1) == 0 || (aidx->clean == 0 && chain_pruned == 0))
+    {
+        aidxClose();
+        if(aidxBuild() == 0 || aidxOpen(1) == 0)
+            return;
+    }
+    aidx->clean = 0;
+
+    //Catch up with records appended since the index was last written
+    int f = open(CHAIN_FILE, O_RDONLY);
+    if(f != -1)
+    {
+        const size_t height = lseek(f, 0, SEEK_END) / sizeof(struct trans);
+        struct trans t;
+        for(size_t i = aidx->height; i < height && aidx != NULL; i++)
+            if(pread(f, &t, sizeof(struct trans), i*sizeof(struct trans)) == sizeof(struct trans))
+                aidxAppend(&t, i);
+        close(f);
+    }
+}
+
+struct ahist
+{
+    uint64_t* rec;      //indexed records of the address, in chain order
+    size_t num;
+    size_t pos;
+    size_t tail;        //first record the index has not seen
+    size_t end;         //records in the mapped chain
+    uint reverse;       //newest first
+};
+
+void ahistOpen(struct ahist* h, const addr* a, const size_t len, const uint reverse)
+{
+    memset(h, 0, sizeof(struct ahist));
+    h->end = len / sizeof(struct trans);
+    h->reverse = reverse;
+
+    //The node reads the index it is writing under the index lock, anything else maps the file
+    const uint own = aidx_write;
+    if(own == 1)
+    {
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    }
+
+    //Without an index the whole chain is the tail
+    if((own == 1 && aidx == NULL) || (own == 0 && aidxOpen(0) == 0))
+    {
+        if(own == 1 && single_threaded == 0)
+            pthread_mutex_unlock(&mutex8);
+        return;
+    }
+
+    //The count is written before the head, read in the opposite order
+    const uint64_t height = aidx->height;
+    const struct aidx_slot* s = aidxFind(aidx, a->key);
+    uint64_t n = 0, c = 0;
+    if(s != NULL)
+    {
+        n = s->head;
+        __sync_synchronize();
+        c = s->count;
+        h->rec = malloc(c * sizeof(uint64_t));
+    }
+
+    if(s == NULL || h->rec != NULL)
+    {
+        //Walk the list back from the newest posting, anything past the header height is left to the tail scan
+        struct apst p;
+        while(n != 0 && h->num < c)
+        {
+            if(pread(apst_fd, &p, sizeof(struct apst), 2*sizeof(uint64_t) + (n-1)*sizeof(struct apst)) != sizeof(struct apst))
+                break;
+            if(p.rec < height && p.rec < h->end)
+                h->rec[h->num++] = p.rec;
+            n = p.prev;
+        }
+
+        //Into chain order
+        for(size_t i = 0; i < h->num/2; i++)
+        {
+            const uint64_t r = h->rec[i];
+            h->rec[i] = h->rec[h->num-1-i];
+            h->rec[h->num-1-i] = r;
+        }
+
+        h->tail = height < h->end ? height : h->end;
+    }
+
+    if(own == 1)
+    {
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    }
+    else
+        aidxClose();
+}
+
+size_t ahistNext(struct ahist* h)
+{
+    const size_t tn = h->end - h->tail;
+    if(h->pos >= h->num + tn)
+        return h->end * sizeof(struct trans);
+
+    size_t r;
+    const size_t p = h->pos++;
+    if(h->reverse == 0)
+        r = p < h->num ? h->rec[p] : h->tail + (p - h->num);
+    else
+        r = p < tn ? h->end - 1 - p : h->rec[h->num - 1 - (p - tn)];
+
+    return r * sizeof(struct trans);
+}
+
+void ahistClose(struct ahist* h)
+{
+    free(h->rec);
+    h->rec = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Column Projection
+
+    Balance and supply scans only compare the addresses and add up the amount
+    of a record, most of a 144 byte record is its signature. The indexed
+    storage keeps a projection of the chain beside it, the senders, recipients
+    and amounts as three arrays in chain order:
+
+    .vfc/from.col - sender of record i at i*(ECC_CURVE+1)
+    .vfc/to.col - recipient of record i at i*(ECC_CURVE+1)
+    .vfc/amount.col - amount of record i at i*sizeof(mval)
+
+    .vfc/cols.idx holds the number of records projected and the crc64 of the
+    last one, it is validated against the chain the same way as the indexes.
+    A scan reads 70 bytes a record from the columns up to their height and
+    the chain after it. The records a pruned node released read back as zeros
+    in the columns too, an unclean projection of a pruned chain is projected
+    again from the first record it still holds.
+
+    colsInit() - Open or rebuild the projection and catch up with the chain (node only)
+    colsAppend() - Project a record appended to the chain (caller locks mutex8)
+    colsPrune() - Release the columns of pruned records (node only)
+    colsClose() - Flush the columns and mark them clean (node only)
+    colsOpen() - Map the columns read-only, returns the records they hold
+    colsRecord() - Sender, recipient and amount of a record, from the columns or the chain
+    colsRelease() - Unmap the columns
+
+*/
+
+#define COLS_MAGIC 0x31306c6f63636676 //"vfccol01"
+#define COLS_BATCH 4096 //records projected per write when catching up
+
+struct cols_head
+{
+    uint64_t magic;
+    uint64_t height;    //chain records projected
+    uint64_t tail;      //crc64 of the last projected record
+    uint64_t clean;     //1 when the node closed the columns gracefully
+};
+
+struct cols_view
+{
+    const unsigned char* m[3];  //from, to, amount
+    size_t len[3];
+    size_t height;
+};
+
+const char* cols_file[3] = {FROM_COL_FILE, TO_COL_FILE, AMOUNT_COL_FILE};
+const size_t cols_width[3] = {ECC_CURVE+1, ECC_CURVE+1, sizeof(mval)};
+
+struct cols_head* cols = NULL;
+int cols_fd[3] = {-1, -1, -1};
+
+void colsClose()
+{
+    if(cols == NULL)
+        return;
+
+    for(uint k = 0; k < 3; k++)
+    {
+        fdatasync(cols_fd[k]);
+        close(cols_fd[k]);
+        cols_fd[k] = -1;
+    }
+    cols->clean = 1;
+    msync(cols, sizeof(struct cols_head), MS_SYNC);
+    munmap(cols, sizeof(struct cols_head));
+    cols = NULL;
+}
+
+static void colsFail(const char* what)
+{
+    printf("ERROR: %s in the column projection has failed, falling back to chain scans.\n", what);
+    err++;
+
+    //A reader only trusts columns up to a height matching the chain
+    cols->magic = 0;
+    cols->clean = 0;
+    for(uint k = 0; k < 3; k++)
+    {
+        close(cols_fd[k]);
+        cols_fd[k] = -1;
+    }
+    munmap(cols, sizeof(struct cols_head));
+    cols = NULL;
+}
+
+void colsAppend(const struct trans* t, const size_t rec)
+{
+    if(cols == NULL || rec < cols->height)
+        return;
+
+    //The columns have to be written before the height covers them
+    const void* v[3] = {t->from.key, t->to.key, &t->amount};
+    for(uint k = 0; k < 3; k++)
+    {
+        if(pwrite(cols_fd[k], v[k], cols_width[k], rec*cols_width[k]) != (ssize_t)cols_width[k])
+        {
+            colsFail("pwrite()");
+            return;
+        }
+    }
+
+    cols->tail = recordCRC(t);
+    __sync_synchronize();
+    cols->height = rec+1;
+}
+
+//Project the records the columns do not hold yet
+static void colsCatchUp()
+{
+    int f = open(CHAIN_FILE, O_RDONLY);
+    if(f == -1)
+        return;
+
+    const size_t len = lseek(f, 0, SEEK_END);
+    const size_t height = len / sizeof(struct trans);
+    unsigned char* m = height > cols->height ? mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0) : MAP_FAILED;
+    close(f);
+    if(m == MAP_FAILED)
+        return;
+
+    unsigned char* b[3];
+    for(uint k = 0; k < 3; k++)
+        b[k] = malloc(COLS_BATCH * cols_width[k]);
+
+    for(size_t i = cols->height; i < height && b[0] != NULL && b[1] != NULL && b[2] != NULL;)
+    {
+        const size_t n = height - i < COLS_BATCH ? height - i : COLS_BATCH;
+        for(size_t j = 0; j < n; j++)
+        {
+            const struct trans* t = (const struct trans*)(m + (i+j)*sizeof(struct trans));
+            memcpy(b[0] + j*cols_width[0], t->from.key, ECC_CURVE+1);
+            memcpy(b[1] + j*cols_width[1], t->to.key, ECC_CURVE+1);
+            memcpy(b[2] + j*cols_width[2], &t->amount, sizeof(mval));
+        }
+
+        uint k = 0;
+        while(k < 3 && pwrite(cols_fd[k], b[k], n*cols_width[k], i*cols_width[k]) == (ssize_t)(n*cols_width[k]))
+            k++;
+        if(k < 3)
+        {
+            colsFail("pwrite()");
+            break;
+        }
+
+        i += n;
+        cols->tail = recordCRC((const struct trans*)(m + (i-1)*sizeof(struct trans)));
+        __sync_synchronize();
+        cols->height = i;
+    }
+
+    for(uint k = 0; k < 3; k++)
+        free(b[k]);
+    munmap(m, len);
+}
+
+void colsInit()
+{
+    int f = open(COLS_FILE, O_RDWR|O_CREAT, 0644);
+    if(f == -1 || ftruncate(f, sizeof(struct cols_head)) != 0)
+    {
+        printf("ERROR: unable to open '%s', scans read the chain.\n", COLS_FILE);
+        err++;
+        if(f != -1)
+            close(f);
+        return;
+    }
+
+    cols = mmap(NULL, sizeof(struct cols_head), PROT_READ|PROT_WRITE, MAP_SHARED, f, 0);
+    close(f);
+    if(cols == MAP_FAILED)
+    {
+        cols = NULL;
+        return;
+    }
+
+    //Unlike the indexes the columns can always be projected again from what the chain still holds
+    uint valid = cols->magic == COLS_MAGIC && cols->clean == 1 && chainHasTail(cols->height, cols->tail) == 1;
+    for(uint k = 0; k < 3; k++)
+    {
+        cols_fd[k] = open(cols_file[k], O_RDWR|O_CREAT, 0644);
+        if(cols_fd[k] == -1)
+        {
+            colsFail("open()");
+            return;
+        }
+        if((size_t)lseek(cols_fd[k], 0, SEEK_END) < cols->height*cols_width[k])
+            valid = 0;
+    }
+
+    //Start over, the records a pruned node released are left as holes
+    if(valid == 0)
+    {
+        cols->magic = 0;
+        msync(cols, sizeof(struct cols_head), MS_SYNC);
+        for(uint k = 0; k < 3; k++)
+        {
+            if(ftruncate(cols_fd[k], 0) != 0)
+            {
+                colsFail("ftruncate()");
+                return;
+            }
+        }
+        cols->height = chain_pruned;
+        cols->tail = 0;
+        cols->magic = COLS_MAGIC;
+    }
+    cols->clean = 0;
+
+    colsCatchUp();
+}
+
+void colsPrune(const size_t to)
+{
+    if(cols == NULL)
+        return;
+
+    for(uint k = 0; k < 3; k++)
+    {
+        const off_t end = (to * cols_width[k]) & ~(off_t)4095;
+        if(end > 0 && syscall(SYS_fallocate, cols_fd[k], FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE, (off_t)0, end) != 0)
+        {
+            printf("ERROR: fallocate() in colsPrune() has failed, the filesystem may not support hole punching.\n");
+            err++;
+            return;
+        }
+    }
+}
+
+void colsRelease(struct cols_view* c)
+{
+    for(uint k = 0; k < 3; k++)
+        if(c->m[k] != NULL)
+            munmap((void*)c->m[k], c->len[k]);
+    memset(c, 0, sizeof(struct cols_view));
+}
+
+size_t colsOpen(struct cols_view* c)
+{
+    memset(c, 0, sizeof(struct cols_view));
+
+    struct cols_head h;
+    int f = open(COLS_FILE, O_RDONLY);
+    if(f == -1)
+        return 0;
+    const uint ok = pread(f, &h, sizeof(struct cols_head), 0) == sizeof(struct cols_head);
+    close(f);
+
+    //Does the chain still contain what was projected?
+    if(ok == 0 || h.magic != COLS_MAGIC || h.height == 0 || chainHasTail(h.height, h.tail) == 0)
+        return 0;
+
+    for(uint k = 0; k < 3; k++)
+    {
+        f = open(cols_file[k], O_RDONLY);
+        if(f == -1)
+        {
+            colsRelease(c);
+            return 0;
+        }
+
+        const size_t len = h.height * cols_width[k];
+        void* m = (size_t)lseek(f, 0, SEEK_END) >= len ? mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0) : MAP_FAILED;
+        close(f);
+        if(m == MAP_FAILED)
+        {
+            colsRelease(c);
+            return 0;
+        }
+
+        c->m[k] = m;
+        c->len[k] = len;
+    }
+
+    c->height = h.height;
+    return c->height;
+}
+
+//The chain view m is only read past the columns
+inline static void colsRecord(const struct cols_view* c, const unsigned char* m, const size_t i, const uint8_t** from, const uint8_t** to, mval* amount)
+{
+    if(i < c->height)
+    {
+        *from = c->m[0] + i*(ECC_CURVE+1);
+        *to = c->m[1] + i*(ECC_CURVE+1);
+        memcpy(amount, c->m[2] + i*sizeof(mval), sizeof(mval));
+        return;
+    }
+
+    const struct trans* t = (const struct trans*)(m + i*sizeof(struct trans));
+    *from = t->from.key;
+    *to = t->to.key;
+    *amount = t->amount;
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Arrival Times
+
+    Records carry no timestamp, so the node keeps the epoch each record was
+    appended at in .vfc/time.idx, one uint32 per record in chain order after
+    a 24 byte header. The stamps never go backwards so a time window is two
+    binary searches. Records from before the file existed are stamped 0 and
+    records appended while the node was not running take the previous stamp.
+
+    The header holds the height and tail CRC the stamps were last lined up
+    with, when that record is no longer in the chain the stamps belong to a
+    chain that was replaced and the file is started over. A tail that has
+    since been pruned can't be checked and is trusted, like a checkpoint.
+
+    timeInit() - Open the file and line it up with the chain (node only)
+    timeAppend() - Stamp a record appended by process_trans() (caller locks mutex3)
+    timeRange() - First & last record that arrived in a window of epochs
+    timeAt() - Epoch a record arrived at (node only)
+    timeClose() - Close the file
+
+*/
+
+#define TIME_MAGIC 0x3230656d69746676 //"vftime02"
+#define TIME_HEAD 24
+
+int time_fd = -1;
+uint32_t time_last = 0; //newest stamp written
+
+//Record the chain height the stamps line up with & the CRC of its tail
+void timeMark(const size_t height)
+{
+    uint64_t head[3] = {TIME_MAGIC, height, 0};
+    if(height > 0)
+    {
+        struct trans t;
+        const int f = open(CHAIN_FILE, O_RDONLY);
+        if(f == -1)
+            return;
+        const ssize_t r = pread(f, &t, sizeof(struct trans), (height-1) * sizeof(struct trans));
+        close(f);
+        if(r != sizeof(struct trans))
+            return;
+        head[2] = recordCRC(&t);
+    }
+    if(pwrite(time_fd, head, sizeof(head), 0) != sizeof(head))
+        printf("ERROR: Could not write %s.\n", TIME_FILE);
+}
+
+void timeClose()
+{
+    if(time_fd == -1)
+        return;
+
+    //Only stamps of records that reached the disk can be vouched for
+    struct stat st;
+    if(fstat(time_fd, &st) == 0 && st.st_size >= TIME_HEAD)
+    {
+        size_t num = (st.st_size - TIME_HEAD) / sizeof(uint32_t);
+        const size_t height = getChainSize() / sizeof(struct trans);
+        if(num > height)
+            num = height;
+        timeMark(num);
+    }
+
+    close(time_fd);
+    time_fd = -1;
+}
+
+void timeInit()
+{
+    time_fd = open(TIME_FILE, O_RDWR | O_CREAT, 0644);
+    if(time_fd == -1)
+    {
+        printf("ERROR: Could not open %s, arrival times will not be recorded.\n", TIME_FILE);
+        err++;
+        return;
+    }
+
+    //New or foreign file, or the stamps belong to a chain that was replaced, start over
+    const size_t height = getChainSize() / sizeof(struct trans);
+    uint64_t head[3] = {0, 0, 0};
+    if(pread(time_fd, head, sizeof(head), 0) != sizeof(head) || head[0] != TIME_MAGIC || head[1] > height || (head[1] > chain_pruned && chainHasTail(head[1], head[2]) == 0))
+    {
+        head[0] = TIME_MAGIC;
+        head[1] = 0;
+        head[2] = 0;
+        if(ftruncate(time_fd, 0) != 0 || pwrite(time_fd, head, sizeof(head), 0) != sizeof(head))
+        {
+            close(time_fd);
+            time_fd = -1;
+            return;
+        }
+    }
+
+    struct stat st;
+    fstat(time_fd, &st);
+    size_t num = (st.st_size - TIME_HEAD) / sizeof(uint32_t);
+
+    //Drop stamps of records that were truncated from the chain
+    if(num > height)
+    {
+        num = height;
+        if(ftruncate(time_fd, TIME_HEAD + num*sizeof(uint32_t)) != 0)
+            printf("ERROR: Could not truncate %s.\n", TIME_FILE);
+    }
+
+    time_last = 0;
+    if(num > 0 && pread(time_fd, &time_last, sizeof(uint32_t), TIME_HEAD + (num-1)*sizeof(uint32_t)) != sizeof(uint32_t))
+        time_last = 0;
+
+    //Records that arrived without a stamp take the last known one
+    uint32_t fill[4096];
+    for(uint i = 0; i < 4096; i++)
+        fill[i] = time_last;
+    while(num < height)
+    {
+        const size_t n = height - num < 4096 ? height - num : 4096;
+        if(pwrite(time_fd, fill, n*sizeof(uint32_t), TIME_HEAD + num*sizeof(uint32_t)) != (ssize_t)(n*sizeof(uint32_t)))
+        {
+            printf("ERROR: Could not write %s.\n", TIME_FILE);
+            err++;
+            close(time_fd);
+            time_fd = -1;
+            return;
+        }
+        num += n;
+    }
+    timeMark(height);
+}
+
+void timeAppend(const size_t rec)
+{
+    if(time_fd == -1)
+        return;
+
+    uint32_t now = time(0);
+    if(now < time_last)
+        now = time_last;
+    if(pwrite(time_fd, &now, sizeof(uint32_t), TIME_HEAD + rec*sizeof(uint32_t)) == sizeof(uint32_t))
+        time_last = now;
+}
+
+uint32_t timeAt(const size_t rec)
+{
+    uint32_t t = 0;
+    if(time_fd == -1 || pread(time_fd, &t, sizeof(uint32_t), TIME_HEAD + rec*sizeof(uint32_t)) != sizeof(uint32_t))
+        return 0;
+    return t;
+}
+
+//Records [first,last] arrived between the epochs from & to inclusive, 0 if none did
+uint timeRange(const uint32_t from, const uint32_t to, size_t* first, size_t* last)
+{
+    const int f = open(TIME_FILE, O_RDONLY);
+    if(f == -1)
+        return 0;
+
+    const size_t len = lseek(f, 0, SEEK_END);
+    if(len <= TIME_HEAD)
+    {
+        close(f);
+        return 0;
+    }
+
+    unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
+    close(f);
+    if(m == MAP_FAILED)
+        return 0;
+
+    uint rv = 0;
+    const uint32_t* ts = (uint32_t*)(m + TIME_HEAD);
+    const size_t num = (len - TIME_HEAD) / sizeof(uint32_t);
+    if(((uint64_t*)m)[0] == TIME_MAGIC)
+    {
+        //first stamp >= from
+        size_t lo = 0, hi = num;
+        while(lo < hi)
+        {
+            const size_t mid = lo + (hi - lo) / 2;
+            if(ts[mid] < from)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        const size_t a = lo;
+
+        //first stamp > to
+        hi = num;
+        while(lo < hi)
+        {
+            const size_t mid = lo + (hi - lo) / 2;
+            if(ts[mid] <= to)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if(lo > a)
+        {
+            *first = a;
+            *last = lo - 1;
+            rv = 1;
+        }
+    }
+
+    munmap(m, len);
+    return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Append Writer
+
+    The node appends to blocks.dat from one writer thread that keeps the file
+    open. process_trans() reserves the next record number and queues a pointer
+    to its record under mutex3, the writer takes everything queued since its
+    last write and lands it with one pwritev() at the reserved offset. The
+    committing thread updates the ledger and indexes meanwhile and waits for
+    its record once it has released its locks, so no lock is held over the
+    file I/O and concurrent commits share a write.
+
+    The chain height is published once a record is both written and included
+    by the ledger and indexes. Records never move, a failed or short write is
+    retried at the same offset instead of being truncated. The ledger and the
+    indexes already include a batch while it is written, so when it still
+    can't be written after WRITER_RETRIES attempts the node stops before any
+    of its commits return, leaving the indexes unclean to be rebuilt.
+
+    How far a record got when its commit returns is set by `durability`:
+
+    0 - written to the page cache, the kernel flushes it when it likes
+    1 - written, and fdatasync() runs every `durability-interval` ms while there are unsynced writes
+    2 - on disk, fdatasync() runs after every batch before its commits return,
+        a failed one counts as a failed write and the batch is written again
+
+    The writer keeps the latency from queue to return of every commit and of
+    every fdatasync() for `vfc writer`, so the levels can be compared on the
+    node's own disk and load.
+
+    writerInit() - Open blocks.dat for the writer (node only)
+    writerQueue() - Reserve and queue a record, returns the chain size with it (caller locks mutex3)
+    writerApplied() - The ledger and indexes include the records up to a chain size
+    writerWait() - Block until the records up to a chain size are written
+    writerThread() - Write the queued records (node only)
+    writerStats() - Latency report of the active level
+    writerStop() - Let the queue drain and sync on shutdown, 1 if everything queued was written
+
+*/
+
+#define WRITER_RING 1024 //records queued for the writer (power of two, at most IOV_MAX)
+#define WRITER_RETRIES 50 //attempts at a batch 100ms apart before the node stops
+
+int writer_fd = -1;
+const struct trans* writer_ring[WRITER_RING]; //the committing thread's record, valid until writerWait() returns
+uint64_t writer_queued[WRITER_RING];          //CLOCK_MONOTONIC ns it was queued at
+uint64_t writer_base = 0;       //records in blocks.dat when the writer was opened
+uint64_t writer_head = 0;       //records queued since
+uint64_t writer_tail = 0;       //records written since
+uint64_t writer_applied = 0;    //chain size the ledger and indexes include
+pthread_cond_t writer_work;
+pthread_cond_t writer_done = PTHREAD_COND_INITIALIZER;
+
+uint durability = 0;                //See above, set in vfc.cnf
+uint durability_interval = 1000;    //ms between the syncs of level 1
+
+struct writer_stat
+{
+    uint64_t batches;
+    uint64_t records;
+    uint64_t commit_ns;     //queue to return, summed over the records
+    uint64_t commit_max;
+    uint64_t syncs;
+    uint64_t sync_ns;
+    uint64_t sync_max;
+};
+
+struct writer_stat writer_stat; //guarded by mutex11
+
+static uint64_t writerClock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//Caller holds mutex11
+static void writerPublish()
+{
+    const uint64_t written = (writer_base + writer_tail) * sizeof(struct trans);
+    heightSet(written < writer_applied ? written : writer_applied);
+}
+
+void writerInit()
+{
+    writer_fd = open(CHAIN_FILE, O_WRONLY | O_CREAT, 0644);
+    if(writer_fd == -1)
+    {
+        printf("ERROR: Could not open %s for the append writer, records will be written in place.\n", CHAIN_FILE);
+        err++;
+        return;
+    }
+
+    //A torn record at the end is overwritten by the next one
+    writer_base = lseek(writer_fd, 0, SEEK_END) / sizeof(struct trans);
+    writer_applied = writer_base * sizeof(struct trans);
+
+    //The periodic sync waits on the same clock the latencies are taken with
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&writer_work, &ca);
+    pthread_condattr_destroy(&ca);
+
+    if(durability > 2)
+        durability = 2;
+    if(durability_interval == 0)
+        durability_interval = 1;
+}
+
+long writerQueue(const struct trans* t)
+{
+    pthread_mutex_lock(&mutex11);
+    while(writer_head - writer_tail >= WRITER_RING)
+        pthread_cond_wait(&writer_done, &mutex11);
+
+    writer_ring[writer_head & (WRITER_RING-1)] = t;
+    writer_queued[writer_head & (WRITER_RING-1)] = writerClock();
+    writer_head++;
+    const long end = (writer_base + writer_head) * sizeof(struct trans);
+
+    pthread_cond_signal(&writer_work);
+    pthread_mutex_unlock(&mutex11);
+    return end;
+}
+
+void writerApplied(const long end)
+{
+    if(writer_fd == -1)
+    {
+        heightSet(end);
+        return;
+    }
+
+    pthread_mutex_lock(&mutex11);
+    if((uint64_t)end > writer_applied)
+        writer_applied = end;
+    writerPublish();
+    pthread_mutex_unlock(&mutex11);
+}
+
+void writerWait(const long end)
+{
+    if(writer_fd == -1)
+        return;
+
+    pthread_mutex_lock(&mutex11);
+    while((writer_base + writer_tail) * sizeof(struct trans) < (uint64_t)end)
+        pthread_cond_wait(&writer_done, &mutex11);
+    pthread_mutex_unlock(&mutex11);
+}
+
+//1 when blocks.dat is on disk
+static uint writerSync()
+{
+    const uint64_t s = writerClock();
+    const uint ok = fdatasync(writer_fd) == 0;
+    if(ok == 0)
+    {
+        printf("ERROR: fdatasync() in writerThread() has failed.\n");
+        err++;
+    }
+    const uint64_t ns = writerClock() - s;
+
+    pthread_mutex_lock(&mutex11);
+    writer_stat.syncs++;
+    writer_stat.sync_ns += ns;
+    if(ns > writer_stat.sync_max)
+        writer_stat.sync_max = ns;
+    pthread_mutex_unlock(&mutex11);
+    return ok;
+}
+
+//1 when the records [tail,head) are written, a short write carries on from where it stopped
+static uint writerWrite(struct iovec* iov, const uint64_t tail, const uint64_t head)
+{
+    int n = 0;
+    for(uint64_t i = tail; i < head; i++, n++)
+    {
+        iov[n].iov_base = (void*)writer_ring[i & (WRITER_RING-1)];
+        iov[n].iov_len = sizeof(struct trans);
+    }
+
+    off_t at = (writer_base + tail) * sizeof(struct trans);
+    struct iovec* v = iov;
+    while(n > 0)
+    {
+        const ssize_t w = pwritev(writer_fd, v, n, at);
+        if(w <= 0)
+            return 0;
+
+        at += w;
+        size_t left = w;
+        while(n > 0 && left >= v->iov_len)
+        {
+            left -= v->iov_len;
+            v++;
+            n--;
+        }
+        if(n > 0)
+        {
+            v->iov_base = (unsigned char*)v->iov_base + left;
+            v->iov_len -= left;
+        }
+    }
+
+    return 1;
+}
+
+//The ledger and indexes include records blocks.dat can't hold, stop before their commits return
+static void writerHalt()
+{
+    printf("ERROR: blocks.dat could not be written after %u attempts, the node is stopping with its indexes unclean.\n", WRITER_RETRIES);
+    replicaStop();
+    exit(0);
+}
+
+void *writerThread(void *arg)
+{
+    struct iovec iov[WRITER_RING];
+    uint dirty = 0;             //written since the last sync
+    uint64_t due = 0;           //level 1, when the next sync is due
+    while(1)
+    {
+        //Everything queued since the last write is one batch, the ring slots are not reused until the tail passes them
+        pthread_mutex_lock(&mutex11);
+        while(writer_tail == writer_head && (dirty == 0 || writerClock() < due))
+        {
+            if(dirty == 0)
+            {
+                pthread_cond_wait(&writer_work, &mutex11);
+                continue;
+            }
+            struct timespec ts;
+            ts.tv_sec = due / 1000000000ULL;
+            ts.tv_nsec = due % 1000000000ULL;
+            pthread_cond_timedwait(&writer_work, &mutex11, &ts);
+        }
+        const uint64_t tail = writer_tail;
+        const uint64_t head = writer_head;
+        pthread_mutex_unlock(&mutex11);
+
+        //A failed batch is written again at the same offset, at level 2 a failed sync too.
+        //The pages a failed sync leaves behind may be marked clean, only a rewrite makes the next sync cover them.
+        for(uint tries = 0;; tries++)
+        {
+            const uint written = writerWrite(iov, tail, head);
+            if(written == 1 && (durability != 2 || head == tail || writerSync() == 1))
+                break;
+            if(tries == 0 && written == 0)
+            {
+                printf("ERROR: pwritev() in writerThread() has failed, retrying.\n");
+                err++;
+            }
+            if(tries+1 == WRITER_RETRIES)
+                writerHalt();
+            usleep(100000);
+        }
+
+        //Level 1 syncs once the interval is up, a failed sync is tried again at the next one
+        if(head != tail && dirty == 0)
+            due = writerClock() + durability_interval * 1000000ULL;
+        if(head != tail && durability == 1)
+            dirty = 1;
+        if(dirty == 1 && writerClock() >= due)
+        {
+            if(writerSync() == 1)
+                dirty = 0;
+            else
+                due = writerClock() + durability_interval * 1000000ULL;
+        }
+
+        pthread_mutex_lock(&mutex11);
+        const uint64_t now = writerClock();
+        for(uint64_t i = tail; i < head; i++)
+        {
+            const uint64_t ns = now - writer_queued[i & (WRITER_RING-1)];
+            writer_stat.commit_ns += ns;
+            if(ns > writer_stat.commit_max)
+                writer_stat.commit_max = ns;
+        }
+        if(head != tail)
+        {
+            writer_stat.batches++;
+            writer_stat.records += head - tail;
+        }
+        writer_tail = head;
+        writerPublish();
+        pthread_cond_broadcast(&writer_done);
+        pthread_mutex_unlock(&mutex11);
+    }
+
+    return 0;
+}
+
+//level,interval ms,records,batches,avg commit us,max commit us,syncs,avg sync us,max sync us
+void writerStats(char* rep, const size_t rlen)
+{
+    pthread_mutex_lock(&mutex11);
+    const struct writer_stat s = writer_stat;
+    pthread_mutex_unlock(&mutex11);
+
+    snprintf(rep, rlen, "%u,%u,%lu,%lu,%.1f,%.1f,%lu,%.1f,%.1f\n", durability, durability_interval, s.records, s.batches,
+        s.records == 0 ? 0 : (double)s.commit_ns / s.records / 1000, (double)s.commit_max / 1000,
+        s.syncs, s.syncs == 0 ? 0 : (double)s.sync_ns / s.syncs / 1000, (double)s.sync_max / 1000);
+}
+
+uint writerStop()
+{
+    if(writer_fd == -1)
+        return 1;
+
+    //No new commits once the append lock is held, it's kept until the node exits.
+    //The signal may have interrupted its holder, then it's never taken and the queue isn't trusted.
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += 1;
+    const uint locked = single_threaded == 1 || pthread_mutex_timedlock(&mutex3, &ts) == 0;
+
+    //Commits in flight get as long as the writer retries a batch to land
+    uint drained = 0;
+    for(uint i = 0; i < WRITER_RETRIES+10 && drained == 0; i++)
+    {
+        pthread_mutex_lock(&mutex11);
+        drained = writer_tail == writer_head;
+        pthread_mutex_unlock(&mutex11);
+        if(drained == 0)
+            usleep(100000);
+    }
+
+    if(durability != 0)
+        fdatasync(writer_fd);
+    return locked == 1 && drained == 1;
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Storage
+
+    Every chain consumer goes through a storage backend rather than opening
+    blocks.dat itself, so the engine can be swapped with `storage` in vfc.cnf
+    without touching the protocol code. Both engines keep the records in
+    blocks.dat, they differ in what they keep beside it.
+
+    flat_store - blocks.dat alone, UID and address lookups scan the chain
+    indexed_store - blocks.dat with the UID and address indexes and the column projection (default)
+
+    store->open() - Load what the engine keeps beside the chain (node only)
+    store->close() - Flush it on shutdown (node only)
+    store->append() - Append a record, returns the new chain size or an ERROR_ code (caller locks mutex3), see Append Writer
+    store->view() - Map the chain for iteration
+    store->release() - Unmap a view
+    store->findUid() - Record number of a UID or -1
+    store->history() - Records of an address, see ahistOpen()
+    store->height() - Records in the chain
+
+*/
+
+struct chain_view
+{
+    const unsigned char* m; //record i is at m + i*sizeof(struct trans)
+    size_t len;             //bytes mapped
+};
+
+struct store
+{
+    const char* name;
+    void (*open)();
+    void (*close)();
+    long (*append)(const struct trans* t);
+    uint (*view)(struct chain_view* v);
+    void (*release)(struct chain_view* v);
+    int64_t (*findUid)(const uint64_t uid);
+    void (*history)(struct ahist* h, const addr* a, const size_t len, const uint reverse);
+    size_t (*height)();
+};
+
+static size_t chainHeight()
+{
+    return getChainSize() / sizeof(struct trans);
+}
+
+static uint chainView(struct chain_view* v)
+{
+    memset(v, 0, sizeof(struct chain_view));
+
+    int f = open(CHAIN_FILE, O_RDONLY);
+    if(f == -1)
+        return 0;
+
+    const size_t len = lseek(f, 0, SEEK_END);
+    if(len == 0)
+    {
+        close(f);
+        return 0;
+    }
+
+    unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
+    close(f);
+    if(m == MAP_FAILED)
+        return 0;
+
+    v->m = m;
+    v->len = len;
+    return 1;
+}
+
+static void chainRelease(struct chain_view* v)
+{
+    if(v->m != NULL)
+        munmap((void*)v->m, v->len);
+    v->m = NULL;
+    v->len = 0;
+}
+
+//First record at or after start carrying the UID
+static int64_t chainFindUid(const uint64_t uid, const size_t start)
+{
+    if(start >= chainHeight())
+        return -1;
+
+    int64_t r = -1;
+    struct chain_view v;
+    if(chainView(&v) == 1)
+    {
+        uint64_t tuid;
+        for(size_t i = start * sizeof(struct trans); i + sizeof(struct trans) <= v.len; i += sizeof(struct trans))
+        {
+            memcpy(&tuid, v.m+i, sizeof(uint64_t));
+            if(tuid == uid)
+            {
+                r = i / sizeof(struct trans);
+                break;
+            }
+        }
+        chainRelease(&v);
+    }
+
+    return r;
+}
+
+//Append a record to blocks.dat, returns the chain size after it
+static long chainAppend(const struct trans* t)
+{
+    //The node's writer thread lands it, otherwise write it in place
+    if(writer_fd != -1)
+        return writerQueue(t);
+
+    FILE* f = fopen(CHAIN_FILE, "a");
+
+    uint fc = 0;
+    while(f == NULL)
+    {
+        fc++;
+        if(fc > 333)
+        {
+            printf("ERROR: fopen() in chainAppend() has failed.\n");
+            err++;
+            return ERROR_OPEN;
+        }
+
+        f = fopen(CHAIN_FILE, "a");
+    }
+
+    size_t written = 0;
+    fc = 0;
+    while(written == 0)
+    {
+        written = fwrite(t, 1, sizeof(struct trans), f);
+
+        fc++;
+        if(fc > 333)
+        {
+            printf("ERROR: fwrite() in chainAppend() has failed.\n");
+            err++;
+            fclose(f);
+            return ERROR_WRITE;
+        }
+
+        if(written == 0)
+        {
+            fclose(f);
+            f = fopen(CHAIN_FILE, "a");
+            continue;
+        }
+
+        //Did we corrupt the chain?
+        if(written < sizeof(struct trans))
+        {
+            fclose(f);
+
+            printf("ERROR: fwrite() in chainAppend() reverted potential chain corruption.\n");
+
+            //Revert the failed write
+            struct stat st;
+            stat(CHAIN_FILE, &st);
+            forceTruncate(CHAIN_FILE, st.st_size - written);
+
+            //Try again
+            written = 0;
+            f = fopen(CHAIN_FILE, "a");
+            continue;
+        }
+    }
+
+    const long end = ftell(f);
+    fclose(f);
+    return end;
+}
+
+//Flat file: blocks.dat and nothing else
+static void flatOpen(){}
+static void flatClose(){}
+
+static int64_t flatFindUid(const uint64_t uid)
+{
+    return chainFindUid(uid, 0);
+}
+
+static void flatHistory(struct ahist* h, const addr* a, const size_t len, const uint reverse)
+{
+    //The whole chain is the tail
+    memset(h, 0, sizeof(struct ahist));
+    h->end = len / sizeof(struct trans);
+    h->reverse = reverse;
+}
+
+//Indexed: the UID and address indexes are kept in step with every append
+static void indexedOpen()
+{
+    printf("Loading the UID index...\n");
+    uidxInit();
+    if(uidx != NULL)
+        printf("UID Index: %'lu transactions.\n", uidx->height);
+    printf("Loading the address index...\n");
+    aidxInit();
+    if(aidx != NULL)
+        printf("Address Index: %'lu addresses, %'lu transactions.\n", aidx->num, aidx->height);
+    printf("Loading the column projection...\n");
+    colsInit();
+    if(cols != NULL)
+        printf("Columns: %'lu transactions.\n", cols->height);
+}
+
+static void indexedClose()
+{
+    uidxClose();
+    aidxClose();
+    colsClose();
+}
+
+static long indexedAppend(const struct trans* t)
+{
+    const long end = chainAppend(t);
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    if(end >= (long)sizeof(struct trans))
+    {
+        uidxAppend(t, end/sizeof(struct trans) - 1);
+        aidxAppend(t, end/sizeof(struct trans) - 1);
+        colsAppend(t, end/sizeof(struct trans) - 1);
+    }
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    return end;
+}
+
+static int64_t indexedFindUid(const uint64_t uid)
+{
+    //The node probes the index it is writing, anything else maps the file
+    int64_t r = -1;
+    size_t start = 0;
+    if(uidx_write == 1)
+    {
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        if(uidx != NULL)
+        {
+            r = uidxFind(uid);
+            start = uidx->height;
+        }
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    }
+    else if(uidxOpen(0) == 1)
+    {
+        r = uidxFind(uid);
+        start = uidx->height;
+        uidxClose();
+    }
+
+    //Only the records the index has not seen are scanned
+    if(r != -1)
+        return r;
+    return chainFindUid(uid, start);
+}
+
+const struct store flat_store = {"flat", flatOpen, flatClose, chainAppend, chainView, chainRelease, flatFindUid, flatHistory, chainHeight};
+const struct store indexed_store = {"indexed", indexedOpen, indexedClose, indexedAppend, chainView, chainRelease, indexedFindUid, ahistOpen, chainHeight};
+const struct store* store = &indexed_store;
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Ledger Checkpoint
+
+    The node periodically writes the ledger to .vfc/ledger.chk as a snapshot at
+    a given height, entries sorted by address along with the supply accumulators.
+    A short lived CLI process looks an address up with a binary search and only
+    scans the records appended after the snapshot. A snapshot no longer matching
+    the chain is ignored.
+
+    ledgerCheckpoint() - Write a snapshot of the ledger (node only)
+    chkOpen() - Map the snapshot if it is valid for the chain
+    chkBalance() - Chain balance of an address at the snapshot height
+    chkClose() - Unmap the snapshot
+
+*/
+
+#define CHK_MAGIC 0x3230786b68636676 //"vfchkx02"
+
+struct chk_head
+{
+    uint64_t magic;
+    uint64_t height;    //chain records in the snapshot
+    uint64_t tail;      //crc64 of the last record in the snapshot
+    uint64_t num;       //entries
+    uint64_t minted;    //supply accumulators
+    uint64_t circ;
+    uint64_t digest;    //chain digest at the snapshot height
+};
+
+struct chk_ent
+{
+    addr key;
+    uint8_t pad[7];
+    int64_t bal;
+};
+
+struct chk
+{
+    struct chk_head* h;
+    size_t len;
+};
+
+size_t ledger_chk_height = 0;   //Height of the last snapshot written
+uint ledger_checkpoint = 600;   //Seconds between snapshots, zero disables them
+
+int chkCompare(const void* a, const void* b)
+{
+    return memcmp(((const struct chk_ent*)a)->key.key, ((const struct chk_ent*)b)->key.key, ECC_CURVE+1);
+}
+
+void ledgerCheckpoint()
+{
+    if(ledger_ready == 0)
+        return;
+
+    struct chk_head h;
+    memset(&h, 0, sizeof(struct chk_head));
+    h.magic = CHK_MAGIC;
+
+    //Copy the ledger out, the sort and write happen unlocked
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    struct chk_ent* e = malloc((ledger.num+1) * sizeof(struct chk_ent));
+    if(e != NULL)
+    {
+        for(size_t i = 0; i < ledger.cap; i++)
+        {
+            const struct lent* l = (const struct lent*)(ledger.e + i*ledger.esize);
+            if(l->used == 0)
+                continue;
+            memset(&e[h.num], 0, sizeof(struct chk_ent));
+            memcpy(e[h.num].key.key, l->key.key, ECC_CURVE+1);
+            e[h.num].bal = l->bal;
+            h.num++;
+        }
+        h.height = ledger_height;
+        h.minted = ledger_minted;
+        h.circ = ledger_circ;
+        h.digest = chain_digest;
+    }
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    if(e == NULL)
+    {
+        printf("ERROR: malloc() in ledgerCheckpoint() has failed.\n");
+        err++;
+        return;
+    }
+
+    qsort(e, h.num, sizeof(struct chk_ent), chkCompare);
+
+    //The record the snapshot ends on, the chain is only appended to. The ledger
+    //is applied before the writer lands a record, wait for it to be in blocks.dat
+    if(h.height > 0)
+    {
+        writerWait(h.height * sizeof(struct trans));
+
+        int f = open(CHAIN_FILE, O_RDONLY);
+        struct trans t;
+        if(f == -1 || pread(f, &t, sizeof(struct trans), (h.height-1) * sizeof(struct trans)) != sizeof(struct trans))
+        {
+            printf("ERROR: unable to read the last record of the ledger snapshot at height %'lu.\n", h.height);
+            err++;
+            if(f != -1)
+                close(f);
+            free(e);
+            return;
+        }
+        close(f);
+        h.tail = recordCRC(&t);
+    }
+
+    FILE* f = fopen(LEDGER_CHK_FILE ".tmp", "w");
+    if(f == NULL)
+    {
+        printf("ERROR: fopen() in ledgerCheckpoint() has failed.\n");
+        err++;
+        free(e);
+        return;
+    }
+
+    //A pruned node starts from this file, it has to be on disk before it replaces the last one
+    const uint ok = fwrite(&h, sizeof(struct chk_head), 1, f) == 1 && fwrite(e, sizeof(struct chk_ent), h.num, f) == h.num && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    free(e);
+    if(fclose(f) != 0 || ok == 0 || rename(LEDGER_CHK_FILE ".tmp", LEDGER_CHK_FILE) == -1)
+    {
+        printf("ERROR: unable to write '%s'.\n", LEDGER_CHK_FILE);
+        err++;
+        return;
+    }
+
+    ledger_chk_height = h.height;
+}
+
+uint chkOpen(struct chk* c)
+{
+    memset(c, 0, sizeof(struct chk));
+
+    int f = open(LEDGER_CHK_FILE, O_RDONLY);
+    if(f == -1)
+        return 0;
+
+    const size_t len = lseek(f, 0, SEEK_END);
+    if(len < sizeof(struct chk_head))
+    {
+        close(f);
+        return 0;
+    }
+
+    struct chk_head* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
+    close(f);
+    if(m == MAP_FAILED)
+        return 0;
+
+    if(m->magic != CHK_MAGIC || len != sizeof(struct chk_head) + m->num*sizeof(struct chk_ent) || chainHasTail(m->height, m->tail) == 0)
+    {
+        munmap(m, len);
+        return 0;
+    }
+
+    c->h = m;
+    c->len = len;
+    return 1;
+}
+
+//Binary search of entries sorted by address
+int64_t chkFind(const struct chk_ent* e, const size_t num, const uint8_t* key)
+{
+    size_t lo = 0, hi = num;
+    while(lo < hi)
+    {
+        const size_t mid = lo + (hi-lo)/2;
+        const int r = memcmp(e[mid].key.key, key, ECC_CURVE+1);
+        if(r == 0)
+            return e[mid].bal;
+        if(r < 0)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+
+    return 0;
+}
+
+int64_t chkBalance(const struct chk* c, const uint8_t* key)
+{
+    return chkFind((const struct chk_ent*)(c->h+1), c->h->num, key);
+}
+
+void chkClose(struct chk* c)
+{
+    if(c->h != NULL)
+        munmap(c->h, c->len);
+    c->h = NULL;
+    c->len = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Balance History
+
+    Every `balance-history` transactions (default 1,000,000) the node appends
+    the balance of every address at that height to .vfc/history.chk, entries
+    sorted by address as in the ledger snapshot. The balance of an address as
+    of any height is then a binary search in the closest checkpoint at or below
+    it and a scan of at most one interval of records.
+
+    The checkpoints are built from the chain by the general thread, not taken
+    from the ledger, so the transaction path never waits on them. A pruned node
+    does not release the records after its last checkpoint, the next one is
+    built from them.
+
+    histInit() - Drop the checkpoints no longer matching the chain, build the missing ones (node only)
+    histUpdate() - Append the checkpoints the chain has passed (node only)
+    balanceAt() - Chain balance of an address as of a height
+
+*/
+
+#define HIST_MAGIC 0x3130747369686676 //"vfhist01"
+#define MIN_HISTORY_INTERVAL 65536
+
+struct hist_head
+{
+    uint64_t magic;
+    uint64_t height;    //chain records in the checkpoint
+    uint64_t tail;      //crc64 of the last record in the checkpoint
+    uint64_t num;       //entries, struct chk_ent sorted by address
+};
+
+size_t balance_history = 1000000;   //Transactions between checkpoints, zero disables them
+size_t hist_height = 0;             //Height of the last checkpoint written
+size_t hist_last = 0;               //File offset of the last checkpoint
+size_t hist_len = 0;                //Bytes of valid checkpoints
+
+//A pruned record reads back as zeros, its checkpoint was valid when it was released
+static uint histValid(const struct hist_head* h, const size_t pruned)
+{
+    return h->height <= pruned || chainHasTail(h->height, h->tail);
+}
+
+void histUpdate()
+{
+    if(balance_history == 0)
+        return;
+
+    const size_t height = chainHeight();
+    size_t next = (hist_height / balance_history + 1) * balance_history;
+    if(next > height)
+        return;
+
+    struct chain_view v;
+    if(store->view(&v) == 0)
+        return;
+
+    //Balances at the last checkpoint
+    struct amap bal;
+    amap_init(&bal, sizeof(struct lent), 65536);
+    uint ok = 1;
+    if(hist_height > 0)
+    {
+        struct hist_head h;
+        int f = open(HIST_FILE, O_RDONLY);
+        ok = f != -1 && pread(f, &h, sizeof(struct hist_head), hist_last) == sizeof(struct hist_head) && h.height == hist_height;
+        struct chk_ent* e = ok == 1 ? malloc((h.num+1) * sizeof(struct chk_ent)) : NULL;
+        if(e == NULL || pread(f, e, h.num*sizeof(struct chk_ent), hist_last+sizeof(struct hist_head)) != (ssize_t)(h.num*sizeof(struct chk_ent)))
+            ok = 0;
+        for(size_t i = 0; ok == 1 && i < h.num; i++)
+            ((struct lent*)amap_put(&bal, e[i].key.key))->bal = e[i].bal;
+        free(e);
+        if(f != -1)
+            close(f);
+    }
+
+    FILE* f = ok == 1 ? fopen(HIST_FILE, "a") : NULL;
+    ok = f != NULL;
+
+    struct trans t;
+    size_t i = hist_height;
+    while(ok == 1 && next <= height && next*sizeof(struct trans) <= v.len)
+    {
+        //Same precedence as ledgerApply()
+        for(; i < next; i++)
+        {
+            memcpy(&t, v.m + i*sizeof(struct trans), sizeof(struct trans));
+            ((struct lent*)amap_put(&bal, t.to.key))->bal += t.amount;
+            if(memcmp(t.from.key, t.to.key, ECC_CURVE+1) != 0)
+                ((struct lent*)amap_put(&bal, t.from.key))->bal -= t.amount;
+        }
+
+        struct hist_head h;
+        memset(&h, 0, sizeof(struct hist_head));
+        h.magic = HIST_MAGIC;
+        h.height = next;
+        h.tail = recordCRC(&t);
+
+        struct chk_ent* e = malloc((bal.num+1) * sizeof(struct chk_ent));
+        if(e == NULL)
+        {
+            ok = 0;
+            break;
+        }
+        for(size_t j = 0; j < bal.cap; j++)
+        {
+            const struct lent* l = (const struct lent*)(bal.e + j*bal.esize);
+            if(l->used == 0)
+                continue;
+            memset(&e[h.num], 0, sizeof(struct chk_ent));
+            memcpy(e[h.num].key.key, l->key.key, ECC_CURVE+1);
+            e[h.num].bal = l->bal;
+            h.num++;
+        }
+        qsort(e, h.num, sizeof(struct chk_ent), chkCompare);
+
+        //On disk before it is counted, a torn checkpoint is dropped by histInit()
+        ok = fwrite(&h, sizeof(struct hist_head), 1, f) == 1 && fwrite(e, sizeof(struct chk_ent), h.num, f) == h.num && fflush(f) == 0 && fsync(fileno(f)) == 0;
+        free(e);
+        if(ok == 1)
+        {
+            hist_height = next;
+            hist_last = hist_len;
+            hist_len += sizeof(struct hist_head) + h.num*sizeof(struct chk_ent);
+            next += balance_history;
+        }
+    }
+
+    if(f != NULL)
+        fclose(f);
+    amap_free(&bal);
+    store->release(&v);
+
+    if(ok == 0)
+    {
+        printf("ERROR: unable to write '%s', balance history is disabled.\n", HIST_FILE);
+        err++;
+        balance_history = 0;
+    }
+}
+
+void histInit()
+{
+    hist_height = 0;
+    hist_last = 0;
+    hist_len = 0;
+    if(balance_history == 0)
+        return;
+
+    int f = open(HIST_FILE, O_RDWR|O_CREAT, 0644);
+    if(f == -1)
+    {
+        printf("ERROR: unable to open '%s', balance history is disabled.\n", HIST_FILE);
+        err++;
+        balance_history = 0;
+        return;
+    }
+
+    //Keep the checkpoints up to the first one that is torn or no longer matches the chain
+    const size_t len = lseek(f, 0, SEEK_END);
+    struct hist_head h;
+    while(hist_len + sizeof(struct hist_head) <= len && pread(f, &h, sizeof(struct hist_head), hist_len) == sizeof(struct hist_head))
+    {
+        const size_t next = hist_len + sizeof(struct hist_head) + h.num*sizeof(struct chk_ent);
+        if(h.magic != HIST_MAGIC || h.height <= hist_height || next > len || histValid(&h, chain_pruned) == 0)
+            break;
+        hist_height = h.height;
+        hist_last = hist_len;
+        hist_len = next;
+    }
+    if(hist_len != len && ftruncate(f, hist_len) != 0)
+    {
+        printf("ERROR: ftruncate() in histInit() has failed.\n");
+        err++;
+    }
+    close(f);
+
+    //The records after the last checkpoint are needed to build the next
+    if(hist_height < chain_pruned)
+    {
+        printf("ERROR: blocks.dat was pruned past the last balance checkpoint, balance history is disabled.\n");
+        err++;
+        balance_history = 0;
+        return;
+    }
+
+    histUpdate();
+}
+
+//1 with the balance excluding the subG value, 0 when the height is past the chain or its records were pruned
+uint balanceAt(const addr* a, const size_t height, int64_t* bal)
+{
+    *bal = 0;
+    if(height > chainHeight())
+        return 0;
+
+    //The closest checkpoint at or below the height
+    const size_t pruned = chainPruned();
+    size_t start = 0;
+    int f = open(HIST_FILE, O_RDONLY);
+    if(f != -1)
+    {
+        const size_t len = lseek(f, 0, SEEK_END);
+        unsigned char* m = len >= sizeof(struct hist_head) ? mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0) : MAP_FAILED;
+        close(f);
+        if(m != MAP_FAILED)
+        {
+            const struct hist_head* best = NULL;
+            for(size_t o = 0; o + sizeof(struct hist_head) <= len;)
+            {
+                const struct hist_head* h = (const struct hist_head*)(m+o);
+                const size_t next = o + sizeof(struct hist_head) + h->num*sizeof(struct chk_ent);
+                if(h->magic != HIST_MAGIC || next > len || h->height > height)
+                    break;
+                best = h;
+                o = next;
+            }
+
+            if(best != NULL && histValid(best, pruned) == 1)
+            {
+                *bal = chkFind((const struct chk_ent*)(best+1), best->num, a->key);
+                start = best->height;
+            }
+
+            munmap(m, len);
+        }
+    }
+
+    if(start < height && start < pruned)
+        return 0;
+
+    struct chain_view v;
+    if(start < height && store->view(&v) == 1)
+    {
+        struct cols_view c;
+        colsOpen(&c);
+
+        const uint8_t *from, *to;
+        mval amount;
+        for(size_t i = start; i < height && (i+1)*sizeof(struct trans) <= v.len; i++)
+        {
+            colsRecord(&c, v.m, i, &from, &to, &amount);
+            if(memcmp(to, a->key, ECC_CURVE+1) == 0)
+                *bal += amount;
+            else if(memcmp(from, a->key, ECC_CURVE+1) == 0)
+                *bal -= amount;
+        }
+
+        colsRelease(&c);
+        store->release(&v);
+    }
+
+    return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Pruning
+
+    With `prune N` in vfc.cnf the node keeps only the last N transactions of
+    blocks.dat, everything before them is already folded into the ledger
+    snapshot which the ledger is loaded from on the next start. The UID index
+    keeps every UID it has seen so replays of pruned transactions are still
+    refused, and replayHead() only ever reads the tail. The UIDs of the
+    released records are also kept in .vfc/pruned.uid, one uint64 per record
+    in chain order, so the index can still be rebuilt once they are gone.
+
+    The released range is hole punched, blocks.dat keeps its logical size so
+    record numbers, heights and index entries stay valid, pruned records just
+    read back as zeros. The genesis transaction is never released. With `prune-archive 1` they are appended to
+    .vfc/archive.dat first. The number of pruned records is kept in
+    .vfc/pruned.mem and is written, after their UIDs, before anything is released. With balance
+    history on, the records after the last balance checkpoint are kept.
+
+    ledgerLoad() - Start the ledger from the snapshot of a pruned chain
+    chainPrune() - Release the records behind the snapshot (node only)
+
+*/
+
+#define MIN_PRUNE_KEEP 65536 //the quick scan and replays read the tail of the chain
+
+size_t prune_keep = 0;      //Transactions kept by a pruned node, zero keeps the whole chain
+uint prune_archive = 0;     //Append the pruned transactions to .vfc/archive.dat
+
+uint ledgerLoad()
+{
+    struct chk c;
+    if(chkOpen(&c) == 0)
+    {
+        printf("ERROR: blocks.dat has been pruned and '%s' does not match it, the ledger can not be loaded.\n", LEDGER_CHK_FILE);
+        err++;
+        return 0;
+    }
+
+    amap_init(&ledger, sizeof(struct lent), 65536);
+    const struct chk_ent* e = (const struct chk_ent*)(c.h+1);
+    for(size_t i = 0; i < c.h->num; i++)
+    {
+        struct lent* l = amap_put(&ledger, e[i].key.key);
+        l->bal = e[i].bal;
+    }
+    ledger_height = c.h->height;
+    ledger_minted = c.h->minted;
+    ledger_circ = c.h->circ;
+    ledger_chk_height = c.h->height;
+    chain_digest = c.h->digest;
+    chain_digest_height = c.h->height;
+    chkClose(&c);
+
+    //Apply what was appended after the snapshot
+    int f = open(CHAIN_FILE, O_RDONLY);
+    if(f != -1)
+    {
+        const size_t height = lseek(f, 0, SEEK_END) / sizeof(struct trans);
+        struct trans t;
+        for(size_t i = ledger_height; i < height; i++)
+            if(pread(f, &t, sizeof(struct trans), i*sizeof(struct trans)) == sizeof(struct trans))
+                ledgerApply(&t);
+        close(f);
+    }
+
+    ledger_ready = 1;
+    return 1;
+}
+
+void chainPrune()
+{
+    if(prune_keep == 0 || ledger_chk_height == 0)
+        return;
+
+    const size_t height = getChainSize() / sizeof(struct trans);
+    if(height <= prune_keep)
+        return;
+
+    //Never past the record that validates the snapshot, what the UID index holds, or the last balance checkpoint
+    size_t to = height - prune_keep;
+    if(to > ledger_chk_height-1)
+        to = ledger_chk_height-1;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    if(uidx == NULL)
+        to = 0;
+    else if(to > uidx->height)
+        to = uidx->height;
+    if(balance_history != 0 && to >= hist_height)
+        to = hist_height > 0 ? hist_height-1 : 0;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    if(to <= chain_pruned)
+        return;
+
+    int f = open(CHAIN_FILE, O_RDWR);
+    if(f == -1)
+        return;
+
+    //Archive the newly pruned range
+    if(prune_archive == 1)
+    {
+        FILE* a = fopen(ARCHIVE_FILE, "a");
+        uint ok = a != NULL;
+        struct trans t;
+        for(size_t i = chain_pruned; i < to && ok == 1; i++)
+            ok = pread(f, &t, sizeof(struct trans), i*sizeof(struct trans)) == sizeof(struct trans) && fwrite(&t, sizeof(struct trans), 1, a) == 1;
+        if(a != NULL && (fflush(a) != 0 || fsync(fileno(a)) != 0 || fclose(a) != 0))
+            ok = 0;
+        if(ok == 0)
+        {
+            printf("ERROR: unable to write '%s', blocks.dat was not pruned.\n", ARCHIVE_FILE);
+            err++;
+            close(f);
+            return;
+        }
+    }
+
+    //Keep the UIDs of the newly pruned range, a rebuild of the UID index reads them from here
+    int fu = open(PRUNED_UID_FILE, O_WRONLY|O_CREAT, 0644);
+    uint ok = fu != -1;
+
+    //A chain pruned before pruned.uid was kept, its released UIDs are only left in the index
+    if(ok == 1 && (size_t)lseek(fu, 0, SEEK_END) < chain_pruned*sizeof(uint64_t))
+    {
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        const struct uidx_slot* s = uidx != NULL ? uidxSlots() : NULL;
+        for(uint64_t i = 0; s != NULL && i < uidx->cap && ok == 1; i++)
+            if(s[i].rec != 0 && s[i].rec-1 < chain_pruned)
+                ok = pwrite(fu, &s[i].uid, sizeof(uint64_t), (s[i].rec-1)*sizeof(uint64_t)) == sizeof(uint64_t);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    }
+
+    struct trans t;
+    for(size_t i = chain_pruned; i < to && ok == 1; i++)
+        ok = pread(f, &t, sizeof(struct trans), i*sizeof(struct trans)) == sizeof(struct trans) &&
+            pwrite(fu, &t.uid, sizeof(uint64_t), i*sizeof(uint64_t)) == sizeof(uint64_t);
+    if(fu != -1 && (fsync(fu) != 0 || close(fu) != 0))
+        ok = 0;
+    if(ok == 0)
+    {
+        printf("ERROR: unable to write '%s', blocks.dat was not pruned.\n", PRUNED_UID_FILE);
+        err++;
+        close(f);
+        return;
+    }
+
+    //Record the new prune point before anything is released
+    const uint64_t n = to;
+    int fp = open(PRUNED_FILE, O_WRONLY|O_CREAT, 0644);
+    if(fp == -1 || pwrite(fp, &n, sizeof(uint64_t), 0) != sizeof(uint64_t) || fsync(fp) != 0)
+    {
+        printf("ERROR: unable to write '%s', blocks.dat was not pruned.\n", PRUNED_FILE);
+        err++;
+        if(fp != -1)
+            close(fp);
+        close(f);
+        return;
+    }
+    close(fp);
+    chain_pruned = to;
+
+    //Only whole pages are released, the first holds the genesis transaction verifyChain() checks
+    const off_t end = (to * sizeof(struct trans)) & ~(off_t)4095;
+    if(end > 4096 && syscall(SYS_fallocate, f, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE, (off_t)4096, end-4096) != 0)
+    {
+        printf("ERROR: fallocate() in chainPrune() has failed, the filesystem may not support hole punching.\n");
+        err++;
+    }
+
+    close(f);
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    colsPrune(to);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex8);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Chain Segments
+
+    blocks.dat is read as consecutive segments of SEGMENT_RECORDS records.
+    Once the chain has passed the end of a segment the general thread seals
+    it, appending its footer (record count, crc64 of its records, crc64 of its
+    last record, lowest and highest UID) to .vfc/segments.dat. Only the tail
+    after the last sealed segment still takes appends.
+
+    A sealed segment is checked on its own, the sealed segments of a range are
+    checked in parallel. The quick scan and `vfc trunc` verify the signatures
+    of a sealed segment once, its footer remembers it and later scans skip the
+    segment while its records still match the checksum, so a deep scan only
+    spends signature checks on the tail. `vfc segments` checks every sealed
+    segment against blocks.dat.
+
+    The records stay in the one file, byte offsets into blocks.dat are what
+    peers replay from and what every chain view maps.
+
+    segLoad() - Footers of the sealed segments still matching the chain
+    segInit() - Drop the footers no longer matching the chain, seal the missing ones (node only)
+    segUpdate() - Seal the segments the chain has passed (node only)
+    segVerify() - Check the signatures of the sealed segments from a record on
+    segList() - Check every sealed segment against blocks.dat and print it
+
+*/
+
+#define SEG_MAGIC 0x3130676573636676 //"vfcseg01"
+#define SEGMENT_RECORDS 1048576 //records in a segment, 144 mb
+
+#define SEG_SEALED 1    //checksummed
+#define SEG_VERIFIED 2  //checksummed, and the signatures of its records were checked
+#define SEG_PRUNED 3    //released by chainPrune() before it was sealed
+
+struct seg_head
+{
+    uint64_t magic;
+    uint64_t records;   //SEGMENT_RECORDS it was written with
+};
+
+struct seg_foot
+{
+    uint64_t first;     //record number of its first record
+    uint64_t count;
+    uint64_t crc;       //crc64 of its records
+    uint64_t tail;      //crc64 of its last record
+    uint64_t min_uid;
+    uint64_t max_uid;
+    uint32_t state;
+    uint32_t when;      //epoch it was sealed at
+};
+
+struct seg_job
+{
+    const unsigned char* m;     //the chain
+    const struct seg_foot* s;
+    size_t from;                //first record to check the signature of
+    uint sigs;                  //check signatures, or only the checksum
+    uint intact;                //its records match the checksum
+    int64_t bad;                //first record with an invalid signature, -1 if none
+};
+
+struct seg_run
+{
+    struct seg_job* j;
+    size_t num;
+    size_t next;
+};
+
+size_t seg_num = 0;     //sealed segments in segments.dat
+uint seg_ready = 0;     //segInit() succeeded
+
+uint recordSigned(const struct trans* t)
+{
+    //The signature covers the transaction without it
+    struct trans to;
+    memset(&to, 0, sizeof(struct trans));
+    to.uid = t->uid;
+    memcpy(to.from.key, t->from.key, ECC_CURVE+1);
+    memcpy(to.to.key, t->to.key, ECC_CURVE+1);
+    to.amount = t->amount;
+
+    uint8_t thash[ECC_CURVE];
+    makHash(thash, &to);
+    return ecdsa_verify(t->from.key, thash, t->owner.key) != 0;
+}
+
+//A pruned record reads back as zeros, its footer was valid when it was released
+static uint segValid(const struct seg_foot* s, const size_t k, const size_t pruned)
+{
+    const size_t end = s->first + s->count;
+    return s->first == k*SEGMENT_RECORDS && s->count == SEGMENT_RECORDS && s->state >= SEG_SEALED && s->state <= SEG_PRUNED && (end <= pruned || chainHasTail(end, s->tail));
+}
+
+static void segSeal(const struct chain_view* v, const size_t k, const size_t pruned, struct seg_foot* s)
+{
+    memset(s, 0, sizeof(struct seg_foot));
+    s->first = k*SEGMENT_RECORDS;
+    s->count = SEGMENT_RECORDS;
+    s->when = time(0);
+
+    const unsigned char* m = v->m + s->first*sizeof(struct trans);
+    s->tail = recordCRC((const struct trans*)(m + (s->count-1)*sizeof(struct trans)));
+    if(s->first < pruned)
+    {
+        s->state = SEG_PRUNED;
+        return;
+    }
+
+    s->state = SEG_SEALED;
+    s->crc = crc64(0, m, s->count*sizeof(struct trans));
+    s->min_uid = UINT64_MAX;
+    uint64_t uid;
+    for(size_t i = 0; i < s->count; i++)
+    {
+        memcpy(&uid, m + i*sizeof(struct trans), sizeof(uint64_t));
+        if(uid < s->min_uid)
+            s->min_uid = uid;
+        if(uid > s->max_uid)
+            s->max_uid = uid;
+    }
+}
+
+//Caller frees the footers
+size_t segLoad(struct seg_foot** out)
+{
+    *out = NULL;
+    int f = open(SEG_FILE, O_RDONLY);
+    if(f == -1)
+        return 0;
+
+    size_t n = 0;
+    struct seg_head h;
+    const size_t len = lseek(f, 0, SEEK_END);
+    if(len >= sizeof(struct seg_head) && pread(f, &h, sizeof(struct seg_head), 0) == sizeof(struct seg_head) && h.magic == SEG_MAGIC && h.records == SEGMENT_RECORDS)
+    {
+        //Up to the first footer that is torn or no longer matches the chain
+        const size_t max = (len - sizeof(struct seg_head)) / sizeof(struct seg_foot);
+        struct seg_foot* s = malloc((max+1) * sizeof(struct seg_foot));
+        if(s != NULL && pread(f, s, max*sizeof(struct seg_foot), sizeof(struct seg_head)) == (ssize_t)(max*sizeof(struct seg_foot)))
+        {
+            const size_t pruned = chainPruned();
+            while(n < max && segValid(&s[n], n, pruned) == 1)
+                n++;
+            *out = s;
+        }
+        else
+            free(s);
+    }
+
+    close(f);
+    return n;
+}
+
+void segUpdate()
+{
+    if(seg_ready == 0)
+        return;
+
+    const size_t height = chainHeight();
+    if((seg_num+1)*SEGMENT_RECORDS > height)
+        return;
+
+    struct chain_view v;
+    if(store->view(&v) == 0)
+        return;
+
+    int f = open(SEG_FILE, O_WRONLY);
+    uint ok = f != -1;
+    while(ok == 1 && (seg_num+1)*SEGMENT_RECORDS <= height && (seg_num+1)*SEGMENT_RECORDS*sizeof(struct trans) <= v.len)
+    {
+        struct seg_foot s;
+        segSeal(&v, seg_num, chain_pruned, &s);
+        ok = pwrite(f, &s, sizeof(struct seg_foot), sizeof(struct seg_head) + seg_num*sizeof(struct seg_foot)) == sizeof(struct seg_foot);
+        if(ok == 1)
+            seg_num++;
+    }
+
+    //A torn footer is dropped by segLoad()
+    if(f != -1)
+    {
+        fdatasync(f);
+        close(f);
+    }
+    store->release(&v);
+
+    if(ok == 0)
+    {
+        printf("ERROR: unable to write '%s', chain segments are no longer sealed.\n", SEG_FILE);
+        err++;
+        seg_ready = 0;
+    }
+}
+
+void segInit()
+{
+    struct seg_foot* s;
+    seg_num = segLoad(&s);
+    free(s);
+
+    int f = open(SEG_FILE, O_RDWR|O_CREAT, 0644);
+    if(f == -1)
+    {
+        printf("ERROR: unable to open '%s', chain segments are not sealed.\n", SEG_FILE);
+        err++;
+        return;
+    }
+
+    //A new file, or one written for another segment size, starts over
+    struct seg_head h;
+    if(pread(f, &h, sizeof(struct seg_head), 0) != sizeof(struct seg_head) || h.magic != SEG_MAGIC || h.records != SEGMENT_RECORDS)
+    {
+        h.magic = SEG_MAGIC;
+        h.records = SEGMENT_RECORDS;
+        seg_num = 0;
+        if(pwrite(f, &h, sizeof(struct seg_head), 0) != sizeof(struct seg_head))
+        {
+            printf("ERROR: unable to write '%s', chain segments are not sealed.\n", SEG_FILE);
+            err++;
+            close(f);
+            return;
+        }
+    }
+    if(ftruncate(f, sizeof(struct seg_head) + seg_num*sizeof(struct seg_foot)) != 0)
+    {
+        printf("ERROR: ftruncate() in segInit() has failed.\n");
+        err++;
+    }
+    close(f);
+
+    seg_ready = 1;
+    segUpdate();
+}
+
+static void segJob(struct seg_job* j)
+{
+    const struct seg_foot* s = j->s;
+    j->bad = -1;
+    j->intact = s->state != SEG_PRUNED && crc64(0, j->m + s->first*sizeof(struct trans), s->count*sizeof(struct trans)) == s->crc;
+    if(j->sigs == 0 || (j->intact == 1 && s->state == SEG_VERIFIED))
+        return;
+
+    //The genesis record is not signed
+    struct trans t;
+    for(size_t i = j->from > 0 ? j->from : 1; i < s->first + s->count; i++)
+    {
+        memcpy(&t, j->m + i*sizeof(struct trans), sizeof(struct trans));
+        if(recordSigned(&t) == 0)
+        {
+            j->bad = i;
+            return;
+        }
+    }
+}
+
+static void* segWorker(void* arg)
+{
+    struct seg_run* r = arg;
+    size_t k;
+    while((k = __atomic_fetch_add(&r->next, 1, __ATOMIC_RELAXED)) < r->num)
+        segJob(&r->j[k]);
+    return 0;
+}
+
+//One worker per processor, the calling thread is one of them
+static void segRun(struct seg_job* j, const size_t num)
+{
+    struct seg_run r = {j, num, 0};
+    pthread_t tid[64];
+    size_t threads = get_nprocs();
+    if(threads > num)
+        threads = num;
+    if(threads > 64)
+        threads = 64;
+
+    size_t started = 0;
+    for(size_t i = 1; i < threads; i++)
+        if(pthread_create(&tid[started], NULL, segWorker, &r) == 0)
+            started++;
+    segWorker(&r);
+    for(size_t i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+}
+
+//Returns the first record with an invalid signature in a sealed segment, or the record the tail after the sealed segments starts at
+size_t segVerify(const unsigned char* m, const size_t len, const size_t from)
+{
+    struct seg_foot* s;
+    const size_t n = segLoad(&s);
+    if(n == 0 || n*SEGMENT_RECORDS*sizeof(struct trans) > len)
+    {
+        free(s);
+        return from;
+    }
+
+    //The released records of a pruned node are skipped
+    const size_t pruned = chainPruned();
+    struct seg_job* j = malloc(n * sizeof(struct seg_job));
+    size_t num = 0;
+    for(size_t k = 0; j != NULL && k < n; k++)
+    {
+        if(s[k].first + s[k].count <= from || s[k].first < pruned)
+            continue;
+        j[num].m = m;
+        j[num].s = &s[k];
+        j[num].from = s[k].first > from ? s[k].first : from;
+        j[num].sigs = 1;
+        num++;
+    }
+    if(j == NULL)
+    {
+        free(s);
+        return from;
+    }
+    segRun(j, num);
+
+    size_t r = n*SEGMENT_RECORDS > from ? n*SEGMENT_RECORDS : from;
+    int f = open(SEG_FILE, O_WRONLY);
+    for(size_t i = 0; i < num; i++)
+    {
+        const size_t k = j[i].s->first / SEGMENT_RECORDS;
+        if(j[i].bad != -1)
+        {
+            printf("Segment %zu: invalid signature at %li\n", k, j[i].bad);
+            r = j[i].bad;
+            break;
+        }
+
+        //Remember a whole segment was verified while it still matches the checksum
+        if(j[i].intact == 1 && j[i].s->state == SEG_SEALED && j[i].from == j[i].s->first)
+        {
+            const uint32_t state = SEG_VERIFIED;
+            if(f != -1)
+                pwrite(f, &state, sizeof(uint32_t), sizeof(struct seg_head) + k*sizeof(struct seg_foot) + offsetof(struct seg_foot, state));
+        }
+        printf("Segment %zu: %s\n", k, j[i].intact == 1 && j[i].s->state == SEG_VERIFIED ? "unchanged since it was verified" : j[i].intact == 1 ? "verified" : "verified, it no longer matches its checksum");
+    }
+    if(f != -1)
+        close(f);
+
+    free(j);
+    free(s);
+    return r;
+}
+
+//segment,first record,records,min uid,max uid,state
+void segList()
+{
+    struct seg_foot* s;
+    const size_t n = segLoad(&s);
+
+    struct chain_view v;
+    memset(&v, 0, sizeof(struct chain_view));
+    struct seg_job* j = n > 0 ? malloc(n * sizeof(struct seg_job)) : NULL;
+    if(j != NULL && store->view(&v) == 1 && n*SEGMENT_RECORDS*sizeof(struct trans) <= v.len)
+    {
+        for(size_t k = 0; k < n; k++)
+        {
+            j[k].m = v.m;
+            j[k].s = &s[k];
+            j[k].from = s[k].first;
+            j[k].sigs = 0;
+        }
+        segRun(j, n);
+
+        const size_t pruned = chainPruned();
+        for(size_t k = 0; k < n; k++)
+        {
+            const char* state = s[k].first < pruned || s[k].state == SEG_PRUNED ? "pruned" : j[k].intact == 0 ? "MODIFIED" : s[k].state == SEG_VERIFIED ? "verified" : "sealed";
+            printf("%zu,%lu,%lu,%016lx,%016lx,%s\n", k, s[k].first, s[k].count, s[k].min_uid, s[k].max_uid, state);
+        }
+    }
+    store->release(&v);
+    free(j);
+    free(s);
+
+    const size_t height = chainHeight();
+    printf("%zu,%zu,%zu,,,tail\n", n, n*SEGMENT_RECORDS, height > n*SEGMENT_RECORDS ? height - n*SEGMENT_RECORDS : 0);
+}
+
+///////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////
+/////////////////////////////
+///////////////
+////////
+///
+//
+//
+//
+/* ~ Watch List
+
+    Exchanges and pools register their deposit addresses with the node, in
+    .vfc/watch.txt (one address per line, read at startup) or through the
+    query socket. The balance and last activity of every watched address are
+    advanced by process_trans() as it commits, so polling thousands of them
+    is one copy out of memory and a client that passes the height it last saw
+    only gets the addresses that moved since.
+
+    Balances exclude the subG value like the ledger, it is added when listed.
+
+    watchInit() - Register the addresses in .vfc/watch.txt (node only)
+    watchAdd() - Watch an address, its state is taken from the ledger and the address index
+    watchDel() - Stop watching an address
+    watchApply() - Apply a transaction to the watched addresses (caller locks mutex7)
+    watchList() - Print the watched addresses active after a height
+
+*/
+
+struct went //watch entry
+{
+    addr key;
+    uint8_t used;
+    int64_t bal;        //chain balance excluding the subG value
+    uint64_t last;      //height after its newest transaction, zero if it has none
+    uint32_t when;      //epoch its newest transaction arrived at
+};
+
+struct amap watch;
+uint watch_ready = 0;
+
+void watchApply(const struct trans* t)
+{
+    if(watch.num == 0)
+        return;
+
+    //Same precedence as ledgerApply()
+    struct went* e = amap_get(&watch, t->to.key);
+    if(e != NULL)
+    {
+        e->bal += t->amount;
+        e->last = ledger_height;
+        e->when = time(0);
+    }
+
+    if(memcmp(t->from.key, t->to.key, ECC_CURVE+1) != 0)
+    {
+        e = amap_get(&watch, t->from.key);
+        if(e != NULL)
+        {
+            e->bal -= t->amount;
+            e->last = ledger_height;
+            e->when = time(0);
+        }
+    }
+}
 
-        //Check it's not on the cache block
-        if(has_uid(t->uid) == 1)
+//Record number of the newest transaction of an address below a height, -1 if it has none
+static int64_t watchNewest(const addr* a, const size_t height)
+{
+    int64_t r = -1;
+    struct chain_view v;
+    if(store->view(&v) == 0)
+        return r;
+
+    const size_t len = height*sizeof(struct trans) < v.len ? height*sizeof(struct trans) : v.len;
+    struct ahist h;
+    store->history(&h, a, len, 1);
+
+    struct trans t;
+    for(size_t i = ahistNext(&h); i < len; i = ahistNext(&h))
+    {
+        memcpy(&t, v.m+i, sizeof(struct trans));
+        if(memcmp(t.to.key, a->key, ECC_CURVE+1) == 0 || memcmp(t.from.key, a->key, ECC_CURVE+1) == 0)
         {
-            //printf("HAS-UID: %lu\n", t->uid);
-            return 0;
+            r = i / sizeof(struct trans);
+            break;
         }
     }
 
+    ahistClose(&h);
+    store->release(&v);
+    return r;
+}
+
+//1 if the address was added, 0 if it was already watched
+uint watchAdd(const addr* a)
+{
+    //From here on process_trans() keeps it current
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 if(single_threaded == 0)
-pthread_mutex_lock(&mutex5);
+pthread_mutex_lock(&mutex7);
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-    //Check if duplicate transaction
-    int freeindex = -1;
-    for(uint i = 0; i < MAX_TRANS_QUEUE; i++)
+    uint added = 0;
+    const size_t height = ledger_height;
+    if(amap_get(&watch, a->key) == NULL)
     {
-        if(tq[i].amount != 0)
-        {
-            //Is this a possible double spend?
-            if(ir == 1 && replay[i] == 1)
-            {
-                if((memcmp(tq[i].from.key, t->from.key, ECC_CURVE+1) == 0 && memcmp(tq[i].to.key, t->to.key, ECC_CURVE+1) != 0))
-                {
-                    //Log both blocks in bad_blocks
-                    FILE* f = fopen(BADCHAIN_FILE, "a");
-                    if(f)
-                    {
-                        fwrite(&tq[i], sizeof(struct trans), 1, f);
-                        fwrite(t, sizeof(struct trans), 1, f);
-                        fclose(f);
-                    }
-                    tq[i].amount = 0; //It looks like it could be a double spend, terminate the original transaction
-                    add_uid(t->uid, 30); //block uid 30 seconds
-                    add_uid(tq[i].uid, 30); //block original uid 30 seconds
+        struct went* e = amap_put(&watch, a->key);
+        e->bal = ledgerBalance(a);
+        added = 1;
+    }
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 if(single_threaded == 0)
-pthread_mutex_unlock(&mutex5);
+pthread_mutex_unlock(&mutex7);
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-                    return 2; //Don't process this transaction and do tell our peers about this transaction so that they have detect and terminate also.
-                }
-            }
+    if(added == 0)
+        return 0;
 
-            //UID already in queue?
-            if(tq[i].uid == t->uid)
-            {
-                //printf("ALREADY-IN-QUE: %lu\n", t->uid);
+    //The activity before it was added, unless a newer transaction was applied meanwhile
+    const int64_t r = watchNewest(a, height);
+    if(r >= 0)
+    {
+        const uint32_t when = timeAt(r);
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 if(single_threaded == 0)
-pthread_mutex_unlock(&mutex5);
+pthread_mutex_lock(&mutex7);
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-                return 0; //It's not a double spend, just a repeat, don't tell our peers
-            }
+        struct went* e = amap_get(&watch, a->key);
+        if(e != NULL && e->last == 0)
+        {
+            e->last = r+1;
+            e->when = when;
         }
-        
-        if(freeindex == -1 && tq[i].amount == 0)
-            freeindex = i;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
     }
 
-    //if fresh transaction add at available slot
-    if(freeindex != -1)
+    return 1;
+}
+
+//1 if the address was watched
+uint watchDel(const addr* a)
+{
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    const uint had = amap_get(&watch, a->key) != NULL;
+    if(had == 1)
+        amap_del(&watch, a->key);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    return had;
+}
+
+//Rewrite .vfc/watch.txt from the list
+uint watchSave()
+{
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    size_t num = 0;
+    addr* k = malloc((watch.num+1) * sizeof(addr));
+    for(size_t i = 0; k != NULL && i < watch.cap; i++)
     {
-        memcpy(&tq[freeindex], t, sizeof(struct trans));
-        ip[freeindex] = iip;
-        ipo[freeindex] = iipo;
-        replay[freeindex] = ir;
-        delta[freeindex] = time(0);
+        const struct went* e = (const struct went*)(watch.e + i*watch.esize);
+        if(e->used == 1)
+            memcpy(k[num++].key, e->key.key, ECC_CURVE+1);
     }
-    // else
-    // {
-    //     printf("Warning: QUE FULL %u\n", gQueSize());
-    // }
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    if(k == NULL)
+        return 0;
 
-    //Success
-    if(memcmp(t->from.key, t->to.key, ECC_CURVE+1) == 0) //is auth trans
+    FILE* f = fopen(WATCH_FILE ".tmp", "w");
+    uint ok = f != NULL;
+    for(size_t i = 0; i < num && ok == 1; i++)
     {
-        add_uid(crc64(0, (unsigned char*)t->from.key, ECC_CURVE+1), 1600); //1 hr for auth trans
+        char pub[MIN_LEN];
+        memset(pub, 0, sizeof(pub));
+        size_t len = MIN_LEN;
+        b58enc(pub, &len, k[i].key, ECC_CURVE+1);
+        ok = fprintf(f, "%s\n", pub) > 0;
     }
-    else
+    free(k);
+    if(f != NULL && fclose(f) != 0)
+        ok = 0;
+    if(ok == 0 || rename(WATCH_FILE ".tmp", WATCH_FILE) == -1)
     {
-        add_uid(t->uid, 30); //block uid for 9 hours (there can be collisions, as such it's a temporary block)
+        printf("ERROR: unable to write '%s'.\n", WATCH_FILE);
+        err++;
+        return 0;
     }
 
-//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-if(single_threaded == 0)
-pthread_mutex_unlock(&mutex5);
-//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-
     return 1;
 }
 
-//pop the first living transaction index off the Queue
-int gQue()
+void watchInit()
 {
-    const uint mi = qRand(3, MAX_TRANS_QUEUE-3);
-    for(int i = mi; i >= 0; i--) //Check left first, que is stacked left to right
+    amap_init(&watch, sizeof(struct went), 1024);
+    watch_ready = 1;
+
+    FILE* f = fopen(WATCH_FILE, "r");
+    if(f == NULL)
+        return;
+
+    char line[256];
+    while(fgets(line, sizeof(line), f) != NULL)
     {
-        if(i < 0 || i >= MAX_TRANS_QUEUE) //just being sure
-            break;
+        line[strcspn(line, " \r\n")] = 0x00;
+        if(line[0] == 0x00 || strlen(line) >= MIN_LEN)
+            continue;
 
-        if(tq[i].amount != 0)
-            if(time(0) - delta[i] >= 3 || replay[i] == 0) //Only process transactions more than 3 second old [replays are instant]
-                return i;
+        addr a;
+        memset(&a, 0, sizeof(addr));
+        size_t len = ECC_CURVE+1;
+        if(b58tobin(a.key, &len, line, strlen(line)) == 1)
+            watchAdd(&a);
     }
-    for(int i = mi; i < MAX_TRANS_QUEUE; i++) //now check to the right of random index
+    fclose(f);
+
+    printf("Watch List: %'lu addresses.\n", watch.num);
+}
+
+//One address,balance,last height,last epoch line per watched address whose newest transaction is after the height, the current height first
+void watchList(FILE* o, const size_t since)
+{
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    const size_t height = ledger_height;
+    size_t num = 0;
+    struct went* w = malloc((watch.num+1) * sizeof(struct went));
+    for(size_t i = 0; w != NULL && i < watch.cap; i++)
     {
-        if(i < 0 || i >= MAX_TRANS_QUEUE) //just being sure
-            break;
+        const struct went* e = (const struct went*)(watch.e + i*watch.esize);
+        if(e->used == 1 && e->last > since)
+            memcpy(&w[num++], e, sizeof(struct went));
+    }
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-        if(tq[i].amount != 0)
-            if(time(0) - delta[i] >= 3 || replay[i] == 0) //Only process transactions more than 3 second old [replays are instant]
-                return i;
+    fprintf(o, "%lu\n", height);
+    for(size_t i = 0; i < num; i++)
+    {
+        char pub[MIN_LEN];
+        memset(pub, 0, sizeof(pub));
+        size_t len = MIN_LEN;
+        b58enc(pub, &len, w[i].key.key, ECC_CURVE+1);
+
+        const int64_t bal = w[i].bal + isSubGenesisAddress(w[i].key.key, 0);
+        fprintf(o, "%s,%lu,%lu,%u\n", pub, bal < 0 ? 0 : (uint64_t)bal, w[i].last, w[i].when);
     }
-    return -1;
+
+    free(w);
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -1465,48 +6490,182 @@ int gQue()
 uint64_t getMinedSupply()
 {
     uint64_t rv = 0;
+    struct chain_view v;
+    if(store->view(&v) == 1)
+    {
+        struct cols_view c;
+        colsOpen(&c);
+
+        const uint8_t *from, *to;
+        mval amount;
+        for(size_t i = 0; (i+1)*sizeof(struct trans) <= v.len; i++)
+        {
+            colsRecord(&c, v.m, i, &from, &to, &amount);
+
+            if(memcmp(from, genesis_pub, ECC_CURVE+1) != 0)
+            {
+                const uint64_t w = isSubGenesisAddress((uint8_t*)from, 1);
+                if(w > 0)
+                {
+                    rv += w;
+                }
+            }
+        }
+
+        colsRelease(&c);
+        store->release(&v);
+    }
+    return rv;
+}
+
+/*
+    The running node persists its supply accumulators to .vfc/supply.mem with
+    the rest of its state, a CLI process picks them up (or the ledger snapshot)
+    and only adds the records after them. getMinedSupply() and
+    getCirculatingSupply() are the full chain scans, kept for --verify.
+*/
+
+#define SUPPLY_MAGIC 0x3130707075736676 //"vfsupp01"
+
+struct supply_state
+{
+    uint64_t magic;
+    uint64_t height;    //chain records accumulated
+    uint64_t tail;      //crc64 of the last accumulated record
+    uint64_t minted;
+    uint64_t circ;
+};
+
+void saveSupply()
+{
+    struct supply_state ss;
+    memset(&ss, 0, sizeof(struct supply_state));
+    ss.magic = SUPPLY_MAGIC;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    ss.height = ledger_height;
+    ss.minted = ledger_minted;
+    ss.circ = ledger_circ;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    //The ledger is applied before the writer lands a record, the published
+    //height only covers written records. Keep the last state until it catches up.
+    if(ss.height * sizeof(struct trans) > getChainSize())
+        return;
+
+    if(ss.height > 0)
+    {
+        int f = open(CHAIN_FILE, O_RDONLY);
+        struct trans t;
+        if(f == -1 || pread(f, &t, sizeof(struct trans), (ss.height-1) * sizeof(struct trans)) != sizeof(struct trans))
+        {
+            if(f != -1)
+                close(f);
+            return;
+        }
+        close(f);
+        ss.tail = recordCRC(&t);
+    }
+
+    forceWrite(".vfc/supply.mem", &ss, sizeof(struct supply_state));
+}
+
+//Supply accumulators up to the end of the chain, returns the chain height
+size_t getSupplyLocal(uint64_t* minted, uint64_t* circ)
+{
+    *minted = 0;
+    *circ = 0;
+    size_t start = 0;
+
+    //Start from the node's state, or its ledger snapshot
+    struct supply_state ss;
+    memset(&ss, 0, sizeof(struct supply_state));
+    FILE* fs = fopen(".vfc/supply.mem", "r");
+    if(fs)
+    {
+        if(fread(&ss, sizeof(struct supply_state), 1, fs) != 1)
+            ss.magic = 0;
+        fclose(fs);
+    }
+
+    struct chk c;
+    if(ss.magic == SUPPLY_MAGIC && chainHasTail(ss.height, ss.tail) == 1)
+    {
+        *minted = ss.minted;
+        *circ = ss.circ;
+        start = ss.height;
+    }
+    else if(chkOpen(&c) == 1)
+    {
+        *minted = c.h->minted;
+        *circ = c.h->circ;
+        start = c.h->height;
+        chkClose(&c);
+    }
+
+    size_t height = start;
     int f = open(CHAIN_FILE, O_RDONLY);
-    if(f)
+    if(f != -1)
     {
         const size_t len = lseek(f, 0, SEEK_END);
+        height = len / sizeof(struct trans);
 
-        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-        if(m != MAP_FAILED)
+        if(height > start)
         {
-            close(f);
-
-            struct trans t;
-            for(size_t i = 0; i < len; i += sizeof(struct trans))
+            unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
+            if(m != MAP_FAILED)
             {
-                memcpy(&t, m+i, sizeof(struct trans));
+                struct cols_view c;
+                colsOpen(&c);
 
-                if(memcmp(t.from.key, genesis_pub, ECC_CURVE+1) != 0)
+                struct trans t;
+                const uint8_t *from, *to;
+                for(size_t i = start; i < height; i++)
                 {
-                    const uint64_t w = isSubGenesisAddress(t.from.key, 1);
-                    if(w > 0)
-                    {
-                        rv += w;
-                    }
+                    colsRecord(&c, m, i, &from, &to, &t.amount);
+                    memcpy(t.from.key, from, ECC_CURVE+1);
+                    memcpy(t.to.key, to, ECC_CURVE+1);
+                    supplyApply(&t, minted, circ);
                 }
-            }
 
-            munmap(m, len);
+                colsRelease(&c);
+                munmap(m, len);
+            }
         }
 
         close(f);
     }
-    return rv;
+
+    return height;
+}
+
+uint64_t getMinedSupplyLocal()
+{
+    uint64_t minted, circ;
+    getSupplyLocal(&minted, &circ);
+    return minted;
+}
+
+uint64_t getCirculatingSupplyLocal()
+{
+    uint64_t minted, circ;
+    const uint64_t ift = getSupplyLocal(&minted, &circ) * INFLATION_TAX; //every transaction inflates vfc by 1 VFC (1000v). This is a TAX paid to miners.
+    return circ + (ift / 100) * 20; // 20% of the ift tax
 }
 
 //Get circulating supply
 uint64_t getCirculatingSupply()
 {
     //Get the tax
-    struct stat st;
-    stat(CHAIN_FILE, &st);
+    const size_t size = getChainSize();
     uint64_t ift = 0;
-    if(st.st_size > 0)
-        ift = (uint64_t)st.st_size / sizeof(struct trans);
+    if(size > 0)
+        ift = (uint64_t)size / sizeof(struct trans);
     ift *= INFLATION_TAX; //every transaction inflates vfc by 1 VFC (1000v). This is a TAX paid to miners.
 
     //Difficulty burning addresses
@@ -1522,44 +6681,37 @@ uint64_t getCirculatingSupply()
     if(ift > 0)
         rv = (ift / 100) * 20; // 20% of the ift tax
     
-    int f = open(CHAIN_FILE, O_RDONLY);
-    if(f)
+    struct chain_view v;
+    if(store->view(&v) == 1)
     {
-        const size_t len = lseek(f, 0, SEEK_END);
+        const size_t len = v.len;
+        const unsigned char* m = v.m;
 
-        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-        if(m != MAP_FAILED)
+        struct trans t;
+        for(size_t i = 0; i < len; i += sizeof(struct trans))
         {
-            close(f);
-
-            struct trans t;
-            for(size_t i = 0; i < len; i += sizeof(struct trans))
-            {
-                memcpy(&t, m+i, sizeof(struct trans));
+            memcpy(&t, m+i, sizeof(struct trans));
 
-                //Negate payments to difficulty burn addresses
-                if(memcmp(t.to.key, lpub.key, ECC_CURVE+1) == 0 || memcmp(t.to.key, tpub.key, ECC_CURVE+1) == 0)
-                    rv -= t.amount;
+            //Negate payments to difficulty burn addresses
+            if(memcmp(t.to.key, lpub.key, ECC_CURVE+1) == 0 || memcmp(t.to.key, tpub.key, ECC_CURVE+1) == 0)
+                rv -= t.amount;
 
-                //All the paid out subG address values
-                if(memcmp(t.from.key, genesis_pub, ECC_CURVE+1) != 0)
-                {
-                    const uint64_t w = isSubGenesisAddress(t.from.key, 1);
-                    if(w > 0)
-                    {
-                        rv += w;
-                    }
-                }
-                else
+            //All the paid out subG address values
+            if(memcmp(t.from.key, genesis_pub, ECC_CURVE+1) != 0)
+            {
+                const uint64_t w = isSubGenesisAddress(t.from.key, 1);
+                if(w > 0)
                 {
-                    rv += t.amount; //all of the transactions leaving the genesis key
+                    rv += w;
                 }
             }
-
-            munmap(m, len);
+            else
+            {
+                rv += t.amount; //all of the transactions leaving the genesis key
+            }
         }
 
-        close(f);
+        store->release(&v);
     }
     return rv;
 }
@@ -1611,50 +6763,29 @@ void replayHead(const uint ip, const size_t rlen)
     const uint replay_rate = getReplayRate();
 
     //Send block height
-    struct stat st;
-    stat(CHAIN_FILE, &st);
-    if(st.st_size > 0)
+    const size_t size = getChainSize();
+    if(size > 0)
     {
         char pc[MIN_LEN];
         pc[0] = 'h';
         char* ofs = pc + 1;
-        const uint height = st.st_size;
+        const uint height = size;
         memcpy(ofs, &height, sizeof(uint));
         csend(ip, pc, 1+sizeof(uint));
         printf("Replaying Head: %.1f kb to %s\n", (double) ( sizeof(struct trans) * rlen ) / 1000, inet_ntoa(ip_addr));
     }
 
     //Replay blocks
-    FILE* f = fopen(CHAIN_FILE, "r");
-    if(f)
+    struct chain_view v;
+    if(store->view(&v) == 1)
     {
-        fseek(f, 0, SEEK_END);
-        const size_t len = ftell(f);
+        const size_t len = v.len;
         
         size_t end = len-(rlen*sizeof(struct trans)); //top len transactions
         struct trans t;
         for(size_t i = len-sizeof(struct trans); i > end; i -= sizeof(struct trans))
         {
-            fseek(f, i, SEEK_SET);
-
-            uint fc = 0;
-            while(fread(&t, 1, sizeof(struct trans), f) != sizeof(struct trans))
-            {
-                fclose(f);
-                f = fopen(CHAIN_FILE, "r");
-                
-                fc++;
-                if(fc > 333)
-                {
-                    printf("ERROR: fread() in replayHead() #1 has failed for peer %s\n", inet_ntoa(ip_addr));
-                    err++;
-                    fclose(f);
-                    return;
-                }
-
-                if(f == NULL)
-                    continue;
-            }
+            memcpy(&t, v.m+i, sizeof(struct trans));
 
             //Generate Packet (pc)
             const size_t len = 1+sizeof(uint64_t)+ECC_CURVE+1+ECC_CURVE+1+sizeof(mval)+ECC_CURVE+ECC_CURVE;
@@ -1679,7 +6810,7 @@ void replayHead(const uint ip, const size_t rlen)
             usleep(replay_rate);
         }
 
-        fclose(f);
+        store->release(&v);
     }
 }
 
@@ -1692,58 +6823,37 @@ void replayBlocks(const uint ip)
     const uint replay_rate = getReplayRate();
 
     //Send block height
-    struct stat st;
-    stat(CHAIN_FILE, &st);
-    if(st.st_size > 0)
+    const size_t size = getChainSize();
+    if(size > 0)
     {
         char pc[MIN_LEN];
         pc[0] = 'h';
         char* ofs = pc + 1;
-        const uint height = st.st_size;
+        const uint height = size;
         memcpy(ofs, &height, sizeof(uint));
         csend(ip, pc, 1+sizeof(uint));
         printf("Replaying Blocks: %.1f kb to %s\n", (double) ( sizeof(struct trans) * REPLAY_SIZE ) / 1000, inet_ntoa(ip_addr));
     }
 
     //Replay blocks
-    FILE* f = fopen(CHAIN_FILE, "r");
-    if(f)
+    struct chain_view v;
+    if(store->view(&v) == 1)
     {
-        fseek(f, 0, SEEK_END);
-        const size_t len = ftell(f);
-        if(len == 0)
-        {
-            fclose(f);
-            return;
-        }
+        const size_t len = v.len;
 
         //Pick a random block of data from the chain of the specified REPLAY_SIZE
         const size_t rpbs = (sizeof(struct trans)*REPLAY_SIZE);
         const size_t lp = len / rpbs; //How many REPLAY_SIZE fit into the current blockchain length
-        const size_t st = sizeof(struct trans) + (rpbs * qRand(1, lp-1)); //Start at one of these x offsets excluding the end of the last block (no more blocks after this point)
+        uint lo = 1;
+        if(chain_pruned != 0) //Only from what a pruned node still holds
+            lo = chain_pruned / REPLAY_SIZE + 1 < lp-1 ? chain_pruned / REPLAY_SIZE + 1 : lp-1;
+        const size_t st = sizeof(struct trans) + (rpbs * qRand(lo, lp-1)); //Start at one of these x offsets excluding the end of the last block (no more blocks after this point)
         size_t end = st+rpbs; //End after that offset + REPLAY_SIZE amount of transactions later
 
         struct trans t;
-        for(size_t i = st; i < len && i < end; i += sizeof(struct trans))
+        for(size_t i = st; i + sizeof(struct trans) <= len && i < end; i += sizeof(struct trans))
         {
-            fseek(f, i, SEEK_SET);
-
-            uint fc = 0;
-            while(fread(&t, 1, sizeof(struct trans), f) != sizeof(struct trans))
-            {
-                fclose(f);
-                f = fopen(CHAIN_FILE, "r");
-                fc++;
-                if(fc > 333)
-                {
-                    printf("ERROR: fread() in replayBlocks() #2 has failed for peer %s\n", inet_ntoa(ip_addr));
-                    err++;
-                    fclose(f);
-                    return;
-                }
-                if(f == NULL)
-                    continue;
-            }
+            memcpy(&t, v.m+i, sizeof(struct trans));
 
             //Generate Packet (pc)
             const size_t len = 1+sizeof(uint64_t)+ECC_CURVE+1+ECC_CURVE+1+sizeof(mval)+ECC_CURVE+ECC_CURVE;
@@ -1765,7 +6875,7 @@ void replayBlocks(const uint ip)
             usleep(replay_rate);
         }
 
-        fclose(f);
+        store->release(&v);
     }
 }
 void *replayBlocksThread(void *arg)
@@ -1800,9 +6910,7 @@ pthread_mutex_unlock(&mutex1);
         const size_t peer_heigh = getPeerHeigh(peer);
         
         //Get my height
-        struct stat st;
-        stat(CHAIN_FILE, &st);
-        const size_t my_heigh = st.st_size > 0 ? st.st_size / sizeof(struct trans) : 0;
+        const size_t my_heigh = getChainSize() / sizeof(struct trans);
 
         //if peer has a smaller block height
         const int diff = my_heigh - peer_heigh;
@@ -1827,6 +6935,14 @@ pthread_mutex_unlock(&mutex1);
                 }
             }
         }
+        else
+        {
+            //Same height but a different set of transactions, what the peer lacks is most likely recent
+            uint64_t pd, md;
+            size_t mh;
+            if(getPeerDigest(peer, &pd) == 1 && chainDigest(&md, &mh) == 1 && mh == my_heigh && pd != md)
+                replayHead(ip, REPLAY_SIZE);
+        }
     }
 
     //End the thread
@@ -1846,6 +6962,13 @@ void launchReplayThread(const uint32_t ip)
     if(threads >= max_replay_threads)
         return;
 
+    //Nothing to replay to a peer holding the same set of transactions
+    const int peer = getPeer(ip);
+    uint64_t pd, md;
+    size_t mh;
+    if(peer != -1 && getPeerDigest(peer, &pd) == 1 && chainDigest(&md, &mh) == 1 && getPeerHeigh(peer) == mh && pd == md)
+        return;
+
     //Are we already replaying to this IP address?
     uint cp = 1;
     for(uint i = 0; i < max_replay_threads; i++)
@@ -1872,39 +6995,32 @@ void launchReplayThread(const uint32_t ip)
 //dump all trans
 void dumptrans(const size_t offset)
 {
-    int f = open(CHAIN_FILE, O_RDONLY);
-    if(f)
+    struct chain_view v;
+    if(store->view(&v) == 1)
     {
-        const size_t len = lseek(f, 0, SEEK_END);
+        const size_t len = v.len;
+        const unsigned char* m = v.m;
 
-        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-        if(m != MAP_FAILED)
+        struct trans t;
+        for(size_t i = 0; i < len; i += sizeof(struct trans))
         {
-            close(f);
-
-            struct trans t;
-            for(size_t i = 0; i < len; i += sizeof(struct trans))
-            {
-                memcpy(&t, m+i, sizeof(struct trans));
-
-                char topub[MIN_LEN];
-                memset(topub, 0, sizeof(topub));
-                size_t len = MIN_LEN;
-                b58enc(topub, &len, t.to.key, ECC_CURVE+1);
+            memcpy(&t, m+i, sizeof(struct trans));
 
-                char frompub[MIN_LEN];
-                memset(frompub, 0, sizeof(frompub));
-                len = MIN_LEN;
-                b58enc(frompub, &len, t.from.key, ECC_CURVE+1);
+            char topub[MIN_LEN];
+            memset(topub, 0, sizeof(topub));
+            size_t len = MIN_LEN;
+            b58enc(topub, &len, t.to.key, ECC_CURVE+1);
 
-                setlocale(LC_NUMERIC, "");
-                printf("%lu: %s\n\t%s > %'.3f\n", t.uid, frompub, topub, toDB(t.amount));
-            }
+            char frompub[MIN_LEN];
+            memset(frompub, 0, sizeof(frompub));
+            len = MIN_LEN;
+            b58enc(frompub, &len, t.from.key, ECC_CURVE+1);
 
-            munmap(m, len);
+            setlocale(LC_NUMERIC, "");
+            printf("%lu: %s\n\t%s > %'.3f\n", t.uid, frompub, topub, toDB(t.amount));
         }
 
-        close(f);
+        store->release(&v);
     }
 }
 
@@ -1947,346 +7063,681 @@ void dumpbadtrans()
     }
 }
 
-//print sent & recv transactions
-void printAll(addr* a)
+//dump the bad trans of one sender, the indexed records then any the index has not seen yet
+void dumpbadAddr(const addr* a)
 {
-    int f = open(CHAIN_FILE, O_RDONLY);
-    if(f)
-    {
-        const size_t len = lseek(f, 0, SEEK_END);
+    int f = open(BADCHAIN_FILE, O_RDONLY);
+    if(f == -1)
+        return;
+    const size_t recs = lseek(f, 0, SEEK_END) / sizeof(struct trans);
 
-        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-        if(m != MAP_FAILED)
+    size_t start = 0;
+    uint64_t* rl = NULL;
+    size_t rn = 0;
+    const int x = open(BADIDX_FILE, O_RDONLY);
+    if(x != -1)
+    {
+        const size_t len = lseek(x, 0, SEEK_END);
+        const struct bad_head* h = len >= sizeof(struct bad_head) ? mmap(NULL, len, PROT_READ, MAP_SHARED, x, 0) : MAP_FAILED;
+        if(h != MAP_FAILED)
         {
-            close(f);
-
-            struct trans t;
-            for(size_t i = 0; i < len; i += sizeof(struct trans))
+            if(badValid(h, recs, len) == 1 && (rl = malloc((h->recs+1) * sizeof(uint64_t))) != NULL)
             {
-                memcpy(&t, m+i, sizeof(struct trans));
-
-                if(memcmp(&t.from.key, a->key, ECC_CURVE+1) == 0)
-                {
-                    char pub[MIN_LEN];
-                    memset(pub, 0, sizeof(pub));
-                    size_t len = MIN_LEN;
-                    b58enc(pub, &len, t.to.key, ECC_CURVE+1);
-                    setlocale(LC_NUMERIC, "");
-                    printf("OUT,%lu,%s,%'.3f\n", t.uid, pub, toDB(t.amount));
-                }
-                else if(memcmp(&t.to.key, a->key, ECC_CURVE+1) == 0)
+                //First entry of the sender in each run, its records follow in order
+                const struct bad_entry* e = (const struct bad_entry*)(h+1);
+                for(uint64_t r = 0; r < h->runs; e += h->len[r], r++)
                 {
-                    char pub[MIN_LEN];
-                    memset(pub, 0, sizeof(pub));
-                    size_t len = MIN_LEN;
-                    b58enc(pub, &len, t.from.key, ECC_CURVE+1);
-                    setlocale(LC_NUMERIC, "");
-                    printf("IN,%lu,%s,%'.3f\n", t.uid, pub, toDB(t.amount));
+                    size_t lo = 0, hi = h->len[r];
+                    while(lo < hi)
+                    {
+                        const size_t mid = lo + (hi-lo)/2;
+                        if(memcmp(e[mid].key.key, a->key, ECC_CURVE+1) < 0)
+                            lo = mid+1;
+                        else
+                            hi = mid;
+                    }
+                    for(; lo < h->len[r] && memcmp(e[lo].key.key, a->key, ECC_CURVE+1) == 0; lo++)
+                        rl[rn++] = e[lo].rec;
                 }
+                start = h->recs;
             }
+            munmap((void*)h, len);
+        }
+        close(x);
+    }
 
-            munmap(m, len);
+    struct trans t;
+    for(size_t i = 0; i < rn + (recs - start); i++)
+    {
+        const size_t r = i < rn ? rl[i] : start + (i - rn);
+        if(pread(f, &t, sizeof(struct trans), r*sizeof(struct trans)) != sizeof(struct trans))
+            break;
+        if(i >= rn && memcmp(t.from.key, a->key, ECC_CURVE+1) != 0)
+            continue;
+
+        char topub[MIN_LEN];
+        memset(topub, 0, sizeof(topub));
+        size_t len = MIN_LEN;
+        b58enc(topub, &len, t.to.key, ECC_CURVE+1);
+
+        char frompub[MIN_LEN];
+        memset(frompub, 0, sizeof(frompub));
+        len = MIN_LEN;
+        b58enc(frompub, &len, t.from.key, ECC_CURVE+1);
+
+        setlocale(LC_NUMERIC, "");
+        printf("%lu: %s > %s : %'.3f\n", t.uid, frompub, topub, toDB(t.amount));
+    }
+
+    free(rl);
+    close(f);
+}
+
+//print sent & recv transactions
+void printAll(FILE* o, addr* a)
+{
+    struct chain_view v;
+    if(store->view(&v) == 1)
+    {
+        const size_t len = v.len;
+        const unsigned char* m = v.m;
+
+        //Only the records of this address and the chain tail the index has not seen
+        struct ahist h;
+        store->history(&h, a, len, 0);
+
+        struct trans t;
+        for(size_t i = ahistNext(&h); i < len; i = ahistNext(&h))
+        {
+            memcpy(&t, m+i, sizeof(struct trans));
+
+            if(memcmp(&t.from.key, a->key, ECC_CURVE+1) == 0)
+            {
+                char pub[MIN_LEN];
+                memset(pub, 0, sizeof(pub));
+                size_t len = MIN_LEN;
+                b58enc(pub, &len, t.to.key, ECC_CURVE+1);
+                setlocale(LC_NUMERIC, "");
+                fprintf(o, "OUT,%lu,%s,%'.3f\n", t.uid, pub, toDB(t.amount));
+            }
+            else if(memcmp(&t.to.key, a->key, ECC_CURVE+1) == 0)
+            {
+                char pub[MIN_LEN];
+                memset(pub, 0, sizeof(pub));
+                size_t len = MIN_LEN;
+                b58enc(pub, &len, t.from.key, ECC_CURVE+1);
+                setlocale(LC_NUMERIC, "");
+                fprintf(o, "IN,%lu,%s,%'.3f\n", t.uid, pub, toDB(t.amount));
+            }
         }
 
-        close(f);
+        ahistClose(&h);
+        store->release(&v);
     }
 }
 
 //print received transactions
-void printIns(addr* a)
+void printIns(FILE* o, addr* a)
 {
-    int f = open(CHAIN_FILE, O_RDONLY);
-    if(f)
+    struct chain_view v;
+    if(store->view(&v) == 1)
     {
-        const size_t len = lseek(f, 0, SEEK_END);
+        const size_t len = v.len;
+        const unsigned char* m = v.m;
 
-        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-        if(m != MAP_FAILED)
+        //Only the records of this address and the chain tail the index has not seen
+        struct ahist h;
+        store->history(&h, a, len, 0);
+
+        struct trans t;
+        for(size_t i = ahistNext(&h); i < len; i = ahistNext(&h))
         {
-            close(f);
+            memcpy(&t, m+i, sizeof(struct trans));
 
-            struct trans t;
-            for(size_t i = 0; i < len; i += sizeof(struct trans))
+            if(memcmp(&t.to.key, a->key, ECC_CURVE+1) == 0)
             {
-                memcpy(&t, m+i, sizeof(struct trans));
-
-                if(memcmp(&t.to.key, a->key, ECC_CURVE+1) == 0)
-                {
-                    char pub[MIN_LEN];
-                    memset(pub, 0, sizeof(pub));
-                    size_t len = MIN_LEN;
-                    b58enc(pub, &len, t.from.key, ECC_CURVE+1);
-                    setlocale(LC_NUMERIC, "");
-                    //printf("%lu: %s > %'.3f\n", t.uid, pub, toDB(t.amount));
-                    printf("%s > %'.3f\n", pub, toDB(t.amount));
-                }
+                char pub[MIN_LEN];
+                memset(pub, 0, sizeof(pub));
+                size_t len = MIN_LEN;
+                b58enc(pub, &len, t.from.key, ECC_CURVE+1);
+                setlocale(LC_NUMERIC, "");
+                //printf("%lu: %s > %'.3f\n", t.uid, pub, toDB(t.amount));
+                fprintf(o, "%s > %'.3f\n", pub, toDB(t.amount));
             }
-
-            munmap(m, len);
         }
 
-        close(f);
+        ahistClose(&h);
+        store->release(&v);
     }
 }
 
 //print sent transactions
-void printOuts(addr* a)
+void printOuts(FILE* o, addr* a)
 {
-    int f = open(CHAIN_FILE, O_RDONLY);
-    if(f)
+    struct chain_view v;
+    if(store->view(&v) == 1)
     {
-        const size_t len = lseek(f, 0, SEEK_END);
+        const size_t len = v.len;
+        const unsigned char* m = v.m;
 
-        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-        if(m != MAP_FAILED)
+        //Only the records of this address and the chain tail the index has not seen
+        struct ahist h;
+        store->history(&h, a, len, 0);
+
+        struct trans t;
+        for(size_t i = ahistNext(&h); i < len; i = ahistNext(&h))
         {
-            close(f);
+            memcpy(&t, m+i, sizeof(struct trans));
 
-            struct trans t;
-            for(size_t i = 0; i < len; i += sizeof(struct trans))
+            if(memcmp(&t.from.key, a->key, ECC_CURVE+1) == 0)
             {
-                memcpy(&t, m+i, sizeof(struct trans));
-
-                if(memcmp(&t.from.key, a->key, ECC_CURVE+1) == 0)
-                {
-                    char pub[MIN_LEN];
-                    memset(pub, 0, sizeof(pub));
-                    size_t len = MIN_LEN;
-                    b58enc(pub, &len, t.to.key, ECC_CURVE+1);
-                    setlocale(LC_NUMERIC, "");
-                    //printf("%lu: %s > %'.3f\n", t.uid, pub, toDB(t.amount));
-                    printf("%s > %'.3f\n", pub, toDB(t.amount));
-                }
+                char pub[MIN_LEN];
+                memset(pub, 0, sizeof(pub));
+                size_t len = MIN_LEN;
+                b58enc(pub, &len, t.to.key, ECC_CURVE+1);
+                setlocale(LC_NUMERIC, "");
+                //printf("%lu: %s > %'.3f\n", t.uid, pub, toDB(t.amount));
+                fprintf(o, "%s > %'.3f\n", pub, toDB(t.amount));
             }
-
-            munmap(m, len);
         }
 
-        close(f);
+        ahistClose(&h);
+        store->release(&v);
     }
 }
 
 void printtrans(uint fromR, uint toR)
 {
-    int f = open(CHAIN_FILE, O_RDONLY);
-    if(f)
+    struct chain_view v;
+    if(store->view(&v) == 1)
     {
-        const size_t len = lseek(f, 0, SEEK_END);
+        const size_t len = v.len;
+        const unsigned char* m = v.m;
 
-        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-        if(m != MAP_FAILED)
+        struct trans t;
+        for(size_t i = fromR * sizeof(struct trans); i < len; i += sizeof(struct trans))
         {
-            close(f);
+            memcpy(&t, m+i, sizeof(struct trans));
+
+            char from[MIN_LEN];
+            memset(from, 0, sizeof(from));
+            size_t len = MIN_LEN;
+            b58enc(from, &len, t.from.key, ECC_CURVE+1);
+
+            char to[MIN_LEN];
+            memset(to, 0, sizeof(from));
+            size_t len2 = MIN_LEN;
+            b58enc(to, &len2, t.to.key, ECC_CURVE+1);
+
+            char sig[MIN_LEN];
+            memset(sig, 0, sizeof(sig));
+            size_t len3 = MIN_LEN;
+            b58enc(sig, &len3, t.owner.key, ECC_CURVE*2);
+
+            setlocale(LC_NUMERIC, "");
+            printf("%d,%lu,%s,%s,%s,%.3f\n", (int)(i/sizeof(struct trans)), t.uid, from, to, sig, toDB(t.amount));
+
+            if(i >= toR * sizeof(struct trans))
+            {
+                break;
+            }
+        }
+
+        store->release(&v);
+    }
+}
+
+//find a specific transaction by UID
+void findTrans(const uint64_t uid)
+{
+    const int64_t r = store->findUid(uid);
 
+    struct chain_view v;
+    if(r != -1 && store->view(&v) == 1)
+    {
+        if((r+1) * sizeof(struct trans) <= v.len)
+        {
             struct trans t;
-            for(size_t i = fromR * sizeof(struct trans); i < len; i += sizeof(struct trans))
+            memcpy(&t, v.m + r*sizeof(struct trans), sizeof(struct trans));
+
+            char from[MIN_LEN];
+            memset(from, 0, sizeof(from));
+            size_t len = MIN_LEN;
+            b58enc(from, &len, t.from.key, ECC_CURVE+1);
+
+            char to[MIN_LEN];
+            memset(to, 0, sizeof(from));
+            size_t len2 = MIN_LEN;
+            b58enc(to, &len2, t.to.key, ECC_CURVE+1);
+
+            char sig[MIN_LEN];
+            memset(sig, 0, sizeof(sig));
+            size_t len3 = MIN_LEN;
+            b58enc(sig, &len3, t.owner.key, ECC_CURVE*2);
+
+            setlocale(LC_NUMERIC, "");
+            //printf("%lu: %s > %'.3f\n", t.uid, pub, toDB(t.amount));
+            printf("%d,%lu,%s,%s,%s,%.3f\n",(int)r, t.uid, from, to, sig, toDB(t.amount));
+
+            store->release(&v);
+            return;
+        }
+
+        store->release(&v);
+    }
+    printf("Transaction could not be found.\n");
+}
+
+//broadcast x top balance to all peers at the defined delay rate
+void broadcastBalance(addr* from, const uint topx, const uint delay)
+{
+    uint bc = 0;
+    struct chain_view v;
+    if(store->view(&v) == 1)
+    {
+        const size_t len = v.len;
+        const unsigned char* m = v.m;
+
+        //Newest first, the chain tail the index has not seen and then the records of this address
+        struct ahist h;
+        store->history(&h, from, len, 1);
+
+        struct trans t;
+        for(size_t i = ahistNext(&h); i > 0 && i < len; i = ahistNext(&h))
+        {
+            memcpy(&t, m+i, sizeof(struct trans));
+
+            if(memcmp(&t.to.key, from->key, ECC_CURVE+1) == 0 || memcmp(&t.from.key, from->key, ECC_CURVE+1) == 0)
             {
-                memcpy(&t, m+i, sizeof(struct trans));
+                const uint32_t origin = 0;
+                const size_t len = 1+sizeof(uint64_t)+sizeof(uint32_t)+ECC_CURVE+1+ECC_CURVE+1+sizeof(mval)+ECC_CURVE+ECC_CURVE;
+                char pc[MIN_LEN];
+                pc[0] = 't';
+                char* ofs = pc + 1;
+                memcpy(ofs, &origin, sizeof(uint32_t));
+                ofs += sizeof(uint32_t);
+                memcpy(ofs, &t.uid, sizeof(uint64_t));
+                ofs += sizeof(uint64_t);
+                memcpy(ofs, t.from.key, ECC_CURVE+1);
+                ofs += ECC_CURVE+1;
+                memcpy(ofs, t.to.key, ECC_CURVE+1);
+                ofs += ECC_CURVE+1;
+                memcpy(ofs, &t.amount, sizeof(mval));
+                ofs += sizeof(mval);
+                memcpy(ofs, t.owner.key, ECC_CURVE*2);
+                peersBroadcast(pc, len);
+                
+                bc++;
+                if(bc > topx)
+                    break;
 
-                char from[MIN_LEN];
-                memset(from, 0, sizeof(from));
-                size_t len = MIN_LEN;
-                b58enc(from, &len, t.from.key, ECC_CURVE+1);
+                if(delay != 0)
+                    sleep(delay); //prevent double-spend throttling
+            }
+        }
+
+        ahistClose(&h);
+        store->release(&v);
+    }
+}
+
+//re-enforce a transaction over network using sporadic distribution
+void reenforceTrans(const struct trans* t)
+{
+#if MASTER_NODE == 0
+    const uint32_t origin = 0;
+    const size_t len = 1+sizeof(uint64_t)+sizeof(uint32_t)+ECC_CURVE+1+ECC_CURVE+1+sizeof(mval)+ECC_CURVE+ECC_CURVE;
+    char pc[MIN_LEN];
+    pc[0] = 't'; //send as a regular transaction, bypass replay allow blocking but will have double spend throttling
+    char* ofs = pc + 1;
+    memcpy(ofs, &origin, sizeof(uint32_t));
+    ofs += sizeof(uint32_t);
+    memcpy(ofs, &t->uid, sizeof(uint64_t));
+    ofs += sizeof(uint64_t);
+    memcpy(ofs, t->from.key, ECC_CURVE+1);
+    ofs += ECC_CURVE+1;
+    memcpy(ofs, t->to.key, ECC_CURVE+1);
+    ofs += ECC_CURVE+1;
+    memcpy(ofs, &t->amount, sizeof(mval));
+    ofs += sizeof(mval);
+    memcpy(ofs, t->owner.key, ECC_CURVE*2);
+    triBroadcast(pc, len, 3); //Just tell a random few peers or we will start triggering transaction duplication logs in badblocks 
+    //                        particularly on outgoing transactions. This is just to support the replay redundency at a minimal cost.
+#endif
+}
+
+//re-enforce what a scan by getBalanceLocal() would, when the balance came from the running node or its replica
+void reenforceAddress(addr* a)
+{
+#if MASTER_NODE == 0
+    size_t start = 0;
+    struct chk c;
+    if(chkOpen(&c) == 1)
+    {
+        start = c.h->height;
+        chkClose(&c);
+    }
+
+    struct chain_view v;
+    if(store->view(&v) == 1)
+    {
+        const size_t len = v.len;
+        const unsigned char* m = v.m;
+
+        //Only the records of this address, newer than the ledger snapshot the scan starts from
+        struct ahist h;
+        store->history(&h, a, len, 0);
+
+        struct trans t;
+        for(size_t i = ahistNext(&h); i < len; i = ahistNext(&h))
+        {
+            if(i < start * sizeof(struct trans))
+                continue;
+            memcpy(&t, m+i, sizeof(struct trans));
+            if(memcmp(t.to.key, a->key, ECC_CURVE+1) == 0 || memcmp(t.from.key, a->key, ECC_CURVE+1) == 0)
+                reenforceTrans(&t);
+        }
+
+        ahistClose(&h);
+        store->release(&v);
+    }
+#endif
+}
+
+//get balance
+uint64_t getBalanceLocal(addr* from)
+{
+    //Get local Balance
+    int64_t rv = isSubGenesisAddress(from->key, 0);
+
+    //The running node answers from the ledger
+    if(ledger_ready == 1)
+    {
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        rv += ledgerBalance(from);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        if(rv < 0)
+            return 0;
+        return rv;
+    }
+
+    //Start from the node's ledger snapshot, only the records after it are scanned
+    size_t start = 0;
+    struct chk c;
+    if(chkOpen(&c) == 1)
+    {
+        rv += chkBalance(&c, from->key);
+        start = c.h->height;
+        chkClose(&c);
+    }
+
+    struct chain_view v;
+    if(store->view(&v) == 1)
+    {
+        const size_t len = v.len;
+        const unsigned char* m = v.m;
 
-                char to[MIN_LEN];
-                memset(to, 0, sizeof(from));
-                size_t len2 = MIN_LEN;
-                b58enc(to, &len2, t.to.key, ECC_CURVE+1);
+        //The columns hold what the compares need, the whole record is only read for a match
+        struct cols_view c;
+        colsOpen(&c);
 
-                char sig[MIN_LEN];
-                memset(sig, 0, sizeof(sig));
-                size_t len3 = MIN_LEN;
-                b58enc(sig, &len3, t.owner.key, ECC_CURVE*2);
+        struct trans t;
+        const uint8_t *tfrom, *tto;
+        mval amount;
+        for(size_t i = start * sizeof(struct trans); i < len; i += sizeof(struct trans))
+        {
+            colsRecord(&c, m, i/sizeof(struct trans), &tfrom, &tto, &amount);
 
-                setlocale(LC_NUMERIC, "");
-                printf("%d,%lu,%s,%s,%s,%.3f\n", (int)(i/sizeof(struct trans)), t.uid, from, to, sig, toDB(t.amount));
+            const uint64_t lrv = rv;
 
-                if(i >= toR * sizeof(struct trans))
-                {
-                    break;
-                }
+            if(memcmp(tto, from->key, ECC_CURVE+1) == 0)
+            {
+                rv += amount;
+            }
+            else if(memcmp(tfrom, from->key, ECC_CURVE+1) == 0)
+            {
+                rv -= amount;
             }
 
-            munmap(m, len);
+            if(lrv != rv)
+            {
+                memcpy(&t, m+i, sizeof(struct trans));
+                reenforceTrans(&t);
+            }
         }
 
-        close(f);
+        colsRelease(&c);
+        store->release(&v);
     }
+
+    if(rv < 0)
+        return 0;
+    return rv;
 }
 
-//find a specific transaction by UID
-void findTrans(const uint64_t uid)
+//Balances of many addresses answered in one pass; bal[] is filled in the order of list[]
+struct bent
 {
-    int f = open(CHAIN_FILE, O_RDONLY);
-    if(f)
+    addr key;
+    uint8_t used;
+    uint32_t idx;
+};
+
+void getBalancesLocal(const addr* list, uint64_t* bal, const size_t num)
+{
+    int64_t* rv = malloc(num * sizeof(int64_t));
+    if(rv == NULL)
     {
-        const size_t len = lseek(f, 0, SEEK_END);
+        for(size_t j = 0; j < num; j++)
+            bal[j] = getBalanceLocal((addr*)&list[j]);
+        return;
+    }
 
-        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-        if(m != MAP_FAILED)
+    //Address set, duplicates share the first entry
+    struct amap set;
+    amap_init(&set, sizeof(struct bent), num*2);
+    for(size_t j = 0; j < num; j++)
+    {
+        rv[j] = 0;
+        struct bent* b = amap_get(&set, list[j].key);
+        if(b == NULL)
         {
-            close(f);
+            b = amap_put(&set, list[j].key);
+            b->idx = j;
+            rv[j] = isSubGenesisAddress((uint8_t*)list[j].key, 0);
+        }
+    }
 
-            struct trans t;
-            for(size_t i = 0; i < len; i += sizeof(struct trans))
+    //The running node answers from the ledger
+    size_t start = 0;
+    uint scan = 1;
+    if(ledger_ready == 1)
+    {
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        for(size_t j = 0; j < num; j++)
+            if(((struct bent*)amap_get(&set, list[j].key))->idx == j)
+                rv[j] += ledgerBalance(&list[j]);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        scan = 0;
+    }
+    else
+    {
+        //A running node's replica, bal[] holds its answers until every address was read at one height
+        struct vfc_replica r;
+        if(replicaOpen(&r, REPLICA_FILE) == 1)
+        {
+            int64_t rb;
+            uint64_t rh, height = 0;
+            uint live = 1;
+            for(uint tries = 0; tries < 16 && live == 1 && scan == 1; tries++)
             {
-                memcpy(&t, m+i, sizeof(struct trans));
-
-                if(t.uid == uid)
+                uint same = 1;
+                for(size_t j = 0; j < num && live == 1 && same == 1; j++)
                 {
-                    char from[MIN_LEN];
-                    memset(from, 0, sizeof(from));
-                    size_t len = MIN_LEN;
-                    b58enc(from, &len, t.from.key, ECC_CURVE+1);
-
-                    char to[MIN_LEN];
-                    memset(to, 0, sizeof(from));
-                    size_t len2 = MIN_LEN;
-                    b58enc(to, &len2, t.to.key, ECC_CURVE+1);
-
-                    char sig[MIN_LEN];
-                    memset(sig, 0, sizeof(sig));
-                    size_t len3 = MIN_LEN;
-                    b58enc(sig, &len3, t.owner.key, ECC_CURVE*2);
-
-                    setlocale(LC_NUMERIC, "");
-                    //printf("%lu: %s > %'.3f\n", t.uid, pub, toDB(t.amount));
-                    printf("%d,%lu,%s,%s,%s,%.3f\n",(int)(i/sizeof(struct trans)), t.uid, from, to, sig, toDB(t.amount));
-
-                    return;
+                    if(((struct bent*)amap_get(&set, list[j].key))->idx != j)
+                        continue;
+                    if(replicaBalance(&r, list[j].key, &rb, &rh) == 0)
+                        live = 0;
+                    else if(j != 0 && rh != height)
+                        same = 0;
+                    else
+                    {
+                        height = rh;
+                        bal[j] = (uint64_t)rb;
+                    }
                 }
+                if(live == 1 && same == 1)
+                    scan = 0;
             }
+            replicaClose(&r);
 
-            munmap(m, len);
+            if(scan == 0)
+                for(size_t j = 0; j < num; j++)
+                    if(((struct bent*)amap_get(&set, list[j].key))->idx == j)
+                        rv[j] += (int64_t)bal[j];
         }
-
-        close(f);
     }
-    printf("Transaction could not be found.\n");
-}
 
-//broadcast x top balance to all peers at the defined delay rate
-void broadcastBalance(addr* from, const uint topx, const uint delay)
-{
-    uint bc = 0;
-    int f = open(CHAIN_FILE, O_RDONLY);
-    if(f)
+    if(scan == 1 && ledger_ready == 0)
     {
-        const size_t len = lseek(f, 0, SEEK_END);
-
-        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-        if(m != MAP_FAILED)
+        //Snapshot lookups, then one scan of the records after it
+        struct chk c;
+        if(chkOpen(&c) == 1)
         {
-            close(f);
-
-            struct trans t;
-            for(size_t i = len-sizeof(struct trans); i > 0; i -= sizeof(struct trans))
-            {
-                memcpy(&t, m+i, sizeof(struct trans));
-
-                if(memcmp(&t.to.key, from->key, ECC_CURVE+1) == 0 || memcmp(&t.from.key, from->key, ECC_CURVE+1) == 0)
-                {
-                    const uint32_t origin = 0;
-                    const size_t len = 1+sizeof(uint64_t)+sizeof(uint32_t)+ECC_CURVE+1+ECC_CURVE+1+sizeof(mval)+ECC_CURVE+ECC_CURVE;
-                    char pc[MIN_LEN];
-                    pc[0] = 't';
-                    char* ofs = pc + 1;
-                    memcpy(ofs, &origin, sizeof(uint32_t));
-                    ofs += sizeof(uint32_t);
-                    memcpy(ofs, &t.uid, sizeof(uint64_t));
-                    ofs += sizeof(uint64_t);
-                    memcpy(ofs, t.from.key, ECC_CURVE+1);
-                    ofs += ECC_CURVE+1;
-                    memcpy(ofs, t.to.key, ECC_CURVE+1);
-                    ofs += ECC_CURVE+1;
-                    memcpy(ofs, &t.amount, sizeof(mval));
-                    ofs += sizeof(mval);
-                    memcpy(ofs, t.owner.key, ECC_CURVE*2);
-                    peersBroadcast(pc, len);
-                    
-                    bc++;
-                    if(bc > topx)
-                        return;
+            for(size_t j = 0; j < num; j++)
+                if(((struct bent*)amap_get(&set, list[j].key))->idx == j)
+                    rv[j] += chkBalance(&c, list[j].key);
+            start = c.h->height;
+            chkClose(&c);
+        }
+    }
 
-                    if(delay != 0)
-                        sleep(delay); //prevent double-spend throttling
-                }
-            }
+    struct chain_view v;
+    if(scan == 1 && store->view(&v) == 1)
+    {
+        struct cols_view c;
+        colsOpen(&c);
 
-            munmap(m, len);
+        const uint8_t *from, *to;
+        mval amount;
+        for(size_t i = start; (i+1)*sizeof(struct trans) <= v.len; i++)
+        {
+            colsRecord(&c, v.m, i, &from, &to, &amount);
+
+            struct bent* b = amap_get(&set, to);
+            if(b != NULL)
+                rv[b->idx] += amount;
+
+            //same precedence as getBalanceLocal(), a self payment only credits
+            if(memcmp(from, to, ECC_CURVE+1) == 0)
+                continue;
+            b = amap_get(&set, from);
+            if(b != NULL)
+                rv[b->idx] -= amount;
         }
 
-        close(f);
+        colsRelease(&c);
+        store->release(&v);
     }
+
+    for(size_t j = 0; j < num; j++)
+    {
+        const int64_t v = rv[((struct bent*)amap_get(&set, list[j].key))->idx];
+        bal[j] = v < 0 ? 0 : v;
+    }
+
+    amap_free(&set);
+    free(rv);
 }
 
-//get balance
-uint64_t getBalanceLocal(addr* from)
+//Read a file of base58 private keys with their public keys and balances
+struct mkey
 {
-    //Get local Balance
-    int64_t rv = isSubGenesisAddress(from->key, 0);
+    char bpriv[256];
+    addr pub;
+    uint64_t bal;
+};
 
-    int f = open(CHAIN_FILE, O_RDONLY);
-    if(f)
-    {
-        const size_t len = lseek(f, 0, SEEK_END);
+struct mkey* loadMintedKeys(const char* path, size_t* num)
+{
+    *num = 0;
+    FILE* f = fopen(path, "r");
+    if(f == NULL)
+        return NULL;
 
-        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-        if(m != MAP_FAILED)
+    size_t cap = 256;
+    struct mkey* k = malloc(cap * sizeof(struct mkey));
+    char bpriv[256];
+    while(k != NULL && fgets(bpriv, 256, f) != NULL)
+    {
+        for(uint i = 0; i < 256; i++)
         {
-            close(f);
-
-            struct trans t;
-            for(size_t i = 0; i < len; i += sizeof(struct trans))
+            if(bpriv[i] == ' ' || bpriv[i] == '\n')
             {
-                memcpy(&t, m+i, sizeof(struct trans));
+                bpriv[i] = 0x00;
+                break;
+            }
+        }
 
-                const uint64_t lrv = rv;
+        if(strlen(bpriv) < 16)
+            continue;
 
-                if(memcmp(&t.to.key, from->key, ECC_CURVE+1) == 0)
-                {
-                    rv += t.amount;
-                }
-                else if(memcmp(&t.from.key, from->key, ECC_CURVE+1) == 0)
-                {
-                    rv -= t.amount;
-                }
+        if(*num == cap)
+        {
+            cap *= 2;
+            struct mkey* nk = realloc(k, cap * sizeof(struct mkey));
+            if(nk == NULL)
+                break;
+            k = nk;
+        }
 
-                if(lrv != rv)
-                {
-#if MASTER_NODE == 0
-                    //re-enforce each transaction over network using sporadic distribution; limited to mmap() branch only
-                    const uint32_t origin = 0;
-                    const size_t len = 1+sizeof(uint64_t)+sizeof(uint32_t)+ECC_CURVE+1+ECC_CURVE+1+sizeof(mval)+ECC_CURVE+ECC_CURVE;
-                    char pc[MIN_LEN];
-                    pc[0] = 't'; //send as a regular transaction, bypass replay allow blocking but will have double spend throttling
-                    char* ofs = pc + 1;
-                    memcpy(ofs, &origin, sizeof(uint32_t));
-                    ofs += sizeof(uint32_t);
-                    memcpy(ofs, &t.uid, sizeof(uint64_t));
-                    ofs += sizeof(uint64_t);
-                    memcpy(ofs, t.from.key, ECC_CURVE+1);
-                    ofs += ECC_CURVE+1;
-                    memcpy(ofs, t.to.key, ECC_CURVE+1);
-                    ofs += ECC_CURVE+1;
-                    memcpy(ofs, &t.amount, sizeof(mval));
-                    ofs += sizeof(mval);
-                    memcpy(ofs, t.owner.key, ECC_CURVE*2);
-                    triBroadcast(pc, len, 3); //Just tell a random few peers or we will start triggering transaction duplication logs in badblocks 
-                    //                        particularly on outgoing transactions. This is just to support the replay redundency at a minimal cost.
-#endif
-                }
-            }
+        //priv as bytes
+        struct addr subg_priv;
+        size_t len = ECC_CURVE;
+        b58tobin(subg_priv.key, &len, bpriv, strlen(bpriv));
 
-            munmap(m, len);
-        }
+        //Gen Public Key
+        memcpy(k[*num].bpriv, bpriv, 256);
+        ecc_get_pubkey(k[*num].pub.key, subg_priv.key);
+        *num += 1;
+    }
+    fclose(f);
 
-        close(f);
+    if(k == NULL)
+        return NULL;
+
+    //Get balance of all the pub keys in one pass
+    addr* list = malloc((*num+1) * sizeof(addr));
+    uint64_t* bal = malloc((*num+1) * sizeof(uint64_t));
+    if(list != NULL && bal != NULL)
+    {
+        for(size_t j = 0; j < *num; j++)
+            memcpy(&list[j], &k[j].pub, sizeof(addr));
+        getBalancesLocal(list, bal, *num);
+        for(size_t j = 0; j < *num; j++)
+            k[j].bal = bal[j];
+    }
+    else
+    {
+        for(size_t j = 0; j < *num; j++)
+            k[j].bal = getBalanceLocal(&k[j].pub);
     }
+    free(list);
+    free(bal);
 
-    if(rv < 0)
-        return 0;
-    return rv;
+    return k;
 }
 
 float liveNetworkDifficulty()
@@ -2305,6 +7756,13 @@ float liveNetworkDifficulty()
     const double lb = toDB(getBalanceLocal(&lpub)); // < MIN_DIFFICULTY vote power in vfc
     const double tb = toDB(getBalanceLocal(&tpub)); //   MIN_DIFFICULTY vote power in vfc
 
+    //The ledger answers without the scan that re-enforces the votes over the network
+    if(ledger_ready == 1)
+    {
+        reenforceAddress(&lpub);
+        reenforceAddress(&tpub);
+    }
+
     //Is higher for MIN_DIFFICULTY
     float ndiff = 0.031;
     if(tb > lb)
@@ -2343,13 +7801,37 @@ int hasbalance(const uint64_t uid, addr* from, mval amount)
     //Is subGenesis?
     int64_t rv = isSubGenesisAddress(from->key, 0);
 
-    //Try to open the chain file
-    int f = open(CHAIN_FILE, O_RDONLY);
+    //The running node has the ledger, only the UID is left to the store
+    if(ledger_ready == 1)
+    {
+        if(store->findUid(uid) != -1)
+            return ERROR_UIDEXIST;
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        rv += ledgerBalance(from);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+        if(rv >= amount)
+            return 1;
+        else
+            return 0;
+    }
 
     //Too critical to fail
+    struct chain_view v;
     uint fc = 0;
-    while(f == -1)
+    while(store->view(&v) == 0)
     {
+        //An empty chain has nothing to check
+        if(store->height() == 0)
+            return rv >= amount;
+
         fc++;
         if(fc > 333)
         {
@@ -2357,44 +7839,34 @@ int hasbalance(const uint64_t uid, addr* from, mval amount)
             err++;
             return ERROR_OPEN;
         }
-
-        f = open(CHAIN_FILE, O_RDONLY);
     }
 
-    //Look's like we have the file handle...
-    const size_t len = lseek(f, 0, SEEK_END);
+    const size_t len = v.len;
+    const unsigned char* m = v.m;
 
-    unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-    if(m != MAP_FAILED)
+    struct trans t;
+    for(size_t i = 0; i < len; i += sizeof(struct trans))
     {
-        close(f);
-
-        struct trans t;
-        for(size_t i = 0; i < len; i += sizeof(struct trans))
+        if(t.uid == uid)
         {
-            if(t.uid == uid)
-            {
-                munmap(m, len);
-                // if(amount == 333)
-                // {
-                //     printf("hasbalance(): UID exists failed\n");
-                //     printf("%lu = %lu\n", t.uid, uid);
-                //     printf("%u = %u\n", t.amount, amount);
-                // }
-                return ERROR_UIDEXIST;
-            }
-            memcpy(&t, m+i, sizeof(struct trans));
-
-            if(memcmp(&t.to.key, from->key, ECC_CURVE+1) == 0)
-                rv += t.amount;
-            else if(memcmp(&t.from.key, from->key, ECC_CURVE+1) == 0)
-                rv -= t.amount;
+            store->release(&v);
+            // if(amount == 333)
+            // {
+            //     printf("hasbalance(): UID exists failed\n");
+            //     printf("%lu = %lu\n", t.uid, uid);
+            //     printf("%u = %u\n", t.amount, amount);
+            // }
+            return ERROR_UIDEXIST;
         }
+        memcpy(&t, m+i, sizeof(struct trans));
 
-        munmap(m, len);
+        if(memcmp(&t.to.key, from->key, ECC_CURVE+1) == 0)
+            rv += t.amount;
+        else if(memcmp(&t.from.key, from->key, ECC_CURVE+1) == 0)
+            rv -= t.amount;
     }
 
-    close(f);
+    store->release(&v);
 
     if(rv >= amount)
         return 1;
@@ -2403,7 +7875,7 @@ int hasbalance(const uint64_t uid, addr* from, mval amount)
 }
 
 
-//rExi check, last line of defense to prevent race conditions if the process mutex fails
+//rExi check, only used as the UID check when the UID index could not be loaded
 uint64_t uidlist[MAX_REXI_SIZE];
 time_t uidtimes[MAX_REXI_SIZE];
 uint rExi(uint64_t uid)
@@ -2427,6 +7899,15 @@ uint rExi(uint64_t uid)
     return 1;
 }
 
+//Sender lock stripes, a sender's balance check and commit hold its stripe so
+//transactions from different senders are verified in parallel and only the append is serialized
+pthread_mutex_t sender_lock[SENDER_STRIPES] = {[0 ... SENDER_STRIPES-1] = PTHREAD_MUTEX_INITIALIZER};
+
+inline static pthread_mutex_t* senderLock(const uint8_t* key)
+{
+    return &sender_lock[addrHash(0, key) & (SENDER_STRIPES-1)];
+}
+
 //Execute Transaction
 int process_trans(const uint64_t uid, addr* from, addr* to, mval amount, sig* owner)
 {
@@ -2450,103 +7931,78 @@ int process_trans(const uint64_t uid, addr* from, addr* to, mval amount, sig* ow
     //Add the sig now we know it's valid
     memcpy(t.owner.key, owner->key, ECC_CURVE*2);
 
+    //The sender's balance can't change under us until the commit is done
+    pthread_mutex_t* sl = senderLock(from->key);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(sl);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
     //Check this address has the required value for the transaction (and that UID is actually unique)
     const int hbr = hasbalance(uid, from, amount);
-    if(hbr == 0)
-    {
-        //printf("ERROR: no balance.\n");
-        return ERROR_NOFUNDS;
-    }
-    else if(hbr < 0)
+    if(hbr <= 0)
     {
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(sl);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        if(hbr == 0)
+        {
+            //printf("ERROR: no balance.\n");
+            return ERROR_NOFUNDS;
+        }
         //printf("ERROR: uid exists.\n");
         return hbr; //it's an error code
     }
 
     //This check after the balance check as we need to verify transactions to self have the balance before confirming 'valid transaction'
     //you still need balance to make a transaction to self
+    long queued = 0;
     if(memcmp(from->key, to->key, ECC_CURVE+1) != 0) //Only log if the user was not sending VFC to themselves.
     {
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 if(single_threaded == 0)
 pthread_mutex_lock(&mutex3);
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-        //The mutex is not preventing race conditions, thats why we have the temporary 1 second expirary rExi / UID check in a limited size buffer. [has_uid()/add_uid() further protects from this condition]
-        if(rExi(uid) == 0)
+        //The UID is checked and indexed under the append lock, two senders can't both commit one UID
+        const int uh = uidxHas(uid);
+        if(uh == 0 || (uh == -1 && rExi(uid) == 0))
         {
-            FILE* f = fopen(CHAIN_FILE, "a");
-
-            uint fc = 0;
-            while(f == NULL)
+            const long end = store->append(&t);
+            if(end < 0)
             {
-                fc++;
-                if(fc > 333)
-                {
-                    printf("ERROR: fopen() in process_trans() has failed.\n");
-                    err++;
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 if(single_threaded == 0)
 pthread_mutex_unlock(&mutex3);
+if(single_threaded == 0)
+pthread_mutex_unlock(sl);
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-                    return ERROR_OPEN;
-                }
-
-                f = fopen(CHAIN_FILE, "a");
+                return end;
             }
 
-            size_t written = 0;
-
-            if(f)
-            {
-                fc = 0;
-                while(written == 0)
-                {
-                    written = fwrite(&t, 1, sizeof(struct trans), f);
-
-                    // if(amount == 3)
-                    //     printf("Special Written: %lu\n", uid);
+            if(end >= (long)sizeof(struct trans))
+                timeAppend(end/sizeof(struct trans) - 1);
 
-                    fc++;
-                    if(fc > 333)
-                    {
-                        printf("ERROR: fwrite() in process_trans() has failed.\n");
-                        err++;
-                        fclose(f);
+            //Advance the ledger
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 if(single_threaded == 0)
-pthread_mutex_unlock(&mutex3);
+pthread_mutex_lock(&mutex7);
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-                        return ERROR_WRITE;
-                    }
-                    
-                    if(written == 0)
-                    {
-                        fclose(f);
-                        f = fopen(CHAIN_FILE, "a");
-                        continue;
-                    }
-                    
-                    //Did we corrupt the chain?
-                    if(written < sizeof(struct trans))
-                    {
-                        fclose(f);
-
-                        printf("ERROR: fwrite() in process_trans() reverted potential chain corruption.\n");
-
-                        //Revert the failed write
-                        struct stat st;
-                        stat(CHAIN_FILE, &st);
-                        forceTruncate(CHAIN_FILE, st.st_size - written);
-
-                        //Try again
-                        written = 0;
-                        f = fopen(CHAIN_FILE, "a");
-                        continue;
-                    }
-                }
-
-                fclose(f);
+            if(ledger_ready == 1)
+            {
+                ledgerApply(&t);
+                replicaApply(&t);
+                watchApply(&t);
             }
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+            //Publish the height once the indexes and ledger include the record
+            if(end > 0)
+                writerApplied(end);
+            queued = end;
         }
 
 // FILE* f = fopen("/var/www/html/p_good.txt", "a");
@@ -2562,6 +8018,15 @@ pthread_mutex_unlock(&mutex3);
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
     }
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(sl);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    //The record is committed, wait for the writer to land it outside of the locks
+    if(queued > 0)
+        writerWait(queued);
     
     //Success
     return 1;
@@ -2664,6 +8129,30 @@ void loadConfig(const uint stat)
 
                 if(strcmp(set, "peer-trans-limit-per-min") == 0) //Default is 180
                     PEER_TRANSACTION_LIMIT_PER_MINUTE = val;
+
+                if(strcmp(set, "ledger-checkpoint") == 0) //Default is 600 seconds, 0 disables the ledger snapshots
+                    ledger_checkpoint = val;
+
+                if(strcmp(set, "storage") == 0) //Default is 1 (indexed), 0 is the flat file alone
+                    store = val == 0 ? &flat_store : &indexed_store;
+
+                if(strcmp(set, "prune") == 0) //Default is 0, keeps the whole chain
+                    prune_keep = val != 0 && val < MIN_PRUNE_KEEP ? MIN_PRUNE_KEEP : val;
+
+                if(strcmp(set, "prune-archive") == 0) //Default is 0, pruned transactions are discarded
+                    prune_archive = val;
+
+                if(strcmp(set, "events") == 0) //Default is 0, 1 keeps the event log of committed transactions
+                    events_on = val;
+
+                if(strcmp(set, "balance-history") == 0) //Default is 1,000,000 transactions between balance checkpoints, 0 disables them
+                    balance_history = val != 0 && val < MIN_HISTORY_INTERVAL ? MIN_HISTORY_INTERVAL : val;
+
+                if(strcmp(set, "durability") == 0) //Default is 0, 1 syncs blocks.dat every durability-interval ms, 2 before every commit returns
+                    durability = val > 2 ? 2 : val;
+
+                if(strcmp(set, "durability-interval") == 0) //Default is 1000 ms between the syncs of durability 1
+                    durability_interval = val == 0 ? 1 : val;
             }
         }
         fclose(f);
@@ -2682,114 +8171,593 @@ void savemem()
         fclose(f);
     }
 
-    f = fopen(".vfc/peers1.mem", "w");
-    if(f)
+    f = fopen(".vfc/peers1.mem", "w");
+    if(f)
+    {
+        fwrite(peer_tcount, sizeof(uint), MAX_PEERS, f);
+        fclose(f);
+    }
+
+    f = fopen(".vfc/peers2.mem", "w");
+    if(f)
+    {
+        fwrite(peer_timeouts, sizeof(time_t), MAX_PEERS, f);
+        fclose(f);
+    }
+
+    f = fopen(".vfc/peers3.mem", "w");
+    if(f)
+    {
+        fwrite(peer_ua, 64, MAX_PEERS, f);
+        fclose(f);
+    }
+
+    forceWrite(".vfc/netdiff.mem", &network_difficulty, sizeof(float));
+
+    //Only the running node has supply accumulators
+    if(ledger_ready == 1)
+        saveSupply();
+}
+
+void loadmem()
+{
+    FILE* f = fopen(".vfc/peers.mem", "r");
+    if(f)
+    {
+        if(fread(peers, sizeof(uint), MAX_PEERS, f) != MAX_PEERS)
+        {
+            printf("Peers Memory Corrupted. Load Failed.\n");
+            err++;
+        }
+        fclose(f);
+    }
+    num_peers = countPeers();
+
+    f = fopen(".vfc/peers1.mem", "r");
+    if(f)
+    {
+        if(fread(peer_tcount, sizeof(uint), MAX_PEERS, f) != MAX_PEERS)
+        {
+            printf("Peers1 Memory Corrupted. Load Failed.\n");
+            err++;
+        }
+        fclose(f);
+    }
+
+    f = fopen(".vfc/peers2.mem", "r");
+    if(f)
+    {
+        if(fread(peer_timeouts, sizeof(uint), MAX_PEERS, f) != MAX_PEERS)
+        {
+            printf("Peers2 Memory Corrupted. Load Failed.\n");
+            err++;
+        }
+        fclose(f);
+    }
+
+    f = fopen(".vfc/peers3.mem", "r");
+    if(f)
+    {
+        if(fread(peer_ua, 64, MAX_PEERS, f) != MAX_PEERS)
+        {
+            printf("Peers3 Memory Corrupted. Load Failed.\n");
+            err++;
+        }
+        fclose(f);
+    }
+
+    setMasterNode();
+}
+
+void sigintHandler(int sig_num) 
+{
+    static int m_qe = 0;
+    
+    if(m_qe == 0)
+    {
+        printf("\nPlease Wait while we save the peers state...\n\n");
+        m_qe = 1;
+
+        savemem();
+
+        //The indexes are only marked clean when every record they include reached blocks.dat
+        if(writerStop() == 1)
+            store->close();
+        else
+            printf("ERROR: The append writer did not drain, the indexes are left to be rebuilt.\n");
+        replicaStop();
+        eventsStop();
+        heightClose();
+        timeClose();
+        exit(0);
+    }
+}
+
+uint isNodeRunning()
+{
+    struct sockaddr_in server;
+
+    int s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if(s == -1)
+        return 1; //Might be running, we can't risk it, say it's running
+
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = INADDR_ANY;
+    server.sin_port = htons(31963);
+    
+    if(bind(s, (struct sockaddr*)&server, sizeof(server)) == 0)
+    {
+        close(s);
+        return 0; //Bind success, we where not already running.
+    }
+
+    close(s);
+    return 1; //Say it's running
+}
+
+/* ~ Local Query Socket
+
+    The running node answers local processes on the unix socket .vfc/vfc.sock,
+    for state that only lives in the node's memory. One request line per
+    connection, the reply is read until the node closes the connection.
+    Amounts are in the chain's units, 1000 to a VFC. History answers can be
+    large, up to QUERY_WORKERS of them are written by worker threads so they
+    don't hold up the other requests, with every worker busy the accept loop
+    answers them itself.
+
+    pending <address> - confirmed,queued in,queued out,pending
+    cooldown <address> - seconds of cooldown left,last refusal
+    balance|all|in|out <address> - answered through the Query Cache below
+    throttle - a reason,count line per refusal reason
+    watch|unwatch <address> - 1 if the watch list changed, see Watch List
+    watched <optional height> - the height, then the watched addresses active after the height
+    writer - durability level and commit latency of the append writer, see writerStats()
+
+    queryAnswer() - Answer a request line
+    queryWatched() - Answer a watch list request, 0 if the request is not one
+    queryThread() - Serve the socket (node only)
+    queryNode() - Send a request to the running node and read the reply
+
+*/
+
+void queryAnswer(const char* req, char* rep, const size_t rlen)
+{
+    char cmd[32], arg[128];
+    memset(cmd, 0, sizeof(cmd));
+    memset(arg, 0, sizeof(arg));
+    const int n = sscanf(req, "%31s %127s", cmd, arg);
+
+    //Confirmed balance with the transactions still waiting in the queue
+    if(n == 2 && strcmp(cmd, "pending") == 0)
+    {
+        addr a;
+        memset(&a, 0, sizeof(addr));
+        size_t len = ECC_CURVE+1;
+        b58tobin(a.key, &len, arg, strlen(arg));
+
+        const uint64_t confirmed = getBalanceLocal(&a);
+        uint64_t in, out;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        pendingGet(&a, &in, &out);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+        int64_t pb = confirmed + in - out;
+        if(pb < 0)
+            pb = 0;
+
+        snprintf(rep, rlen, "%lu,%lu,%lu,%lu\n", confirmed, in, out, (uint64_t)pb);
+        return;
+    }
+
+    //Seconds left on a sender's cooldown and why its last transaction was refused
+    if(n == 2 && strcmp(cmd, "cooldown") == 0)
+    {
+        addr a;
+        memset(&a, 0, sizeof(addr));
+        size_t len = ECC_CURVE+1;
+        b58tobin(a.key, &len, arg, strlen(arg));
+
+        uint remaining, reason;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex5);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        coolStatus(a.key, &remaining, &reason);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex5);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+        snprintf(rep, rlen, "%u,%s\n", remaining, throttle_names[reason]);
+        return;
+    }
+
+    //Refused transactions by reason since the node started
+    if(n == 1 && strcmp(cmd, "throttle") == 0)
+    {
+        size_t o = 0;
+        rep[0] = 0x00;
+        for(uint i = 1; i < THROTTLE_REASONS && o < rlen; i++)
+            o += snprintf(rep+o, rlen-o, "%s,%lu\n", throttle_names[i], throttle_count[i]);
+        return;
+    }
+
+    //Commit and sync latency of the append writer
+    if(n == 1 && strcmp(cmd, "writer") == 0)
+    {
+        writerStats(rep, rlen);
+        return;
+    }
+
+    //Add or drop a watched address, the list is kept in .vfc/watch.txt
+    if(n == 2 && (strcmp(cmd, "watch") == 0 || strcmp(cmd, "unwatch") == 0))
+    {
+        addr a;
+        memset(&a, 0, sizeof(addr));
+        size_t len = ECC_CURVE+1;
+        if(watch_ready == 0 || b58tobin(a.key, &len, arg, strlen(arg)) == 0)
+        {
+            snprintf(rep, rlen, "ERROR: invalid address.\n");
+            return;
+        }
+
+        const uint changed = cmd[0] == 'w' ? watchAdd(&a) : watchDel(&a);
+        if(changed == 1)
+            watchSave();
+        snprintf(rep, rlen, "%u\n", changed);
+        return;
+    }
+
+    snprintf(rep, rlen, "ERROR: unknown request.\n");
+}
+
+uint queryWatched(const char* req, char** out, size_t* olen)
+{
+    char cmd[32];
+    memset(cmd, 0, sizeof(cmd));
+    size_t since = 0;
+    if(sscanf(req, "%31s %zu", cmd, &since) < 1 || strcmp(cmd, "watched") != 0 || watch_ready == 0)
+        return 0;
+
+    FILE* o = open_memstream(out, olen);
+    if(o == NULL)
+        return 0;
+    watchList(o, since);
+    fclose(o);
+    return 1;
+}
+
+/* ~ Query Cache
+
+    Balance and history answers are kept by request and the chain height they
+    were computed at, so repeat queries at the same height are a copy out of
+    memory. The height comes from the counter the append path publishes after
+    the ledger and indexes include the record, an answer is only kept if the
+    height did not move while it was computed. Balances also depend on the
+    network difficulty through the subG value, so it is part of the key.
+
+    Requests are direct mapped on a hash of the request line, a collision or
+    a newer height replaces the slot.
+
+    balance <address> - confirmed balance in chain units
+    all|in|out <address> - history in the format of the cli commands
+
+    queryCached() - Answer a cacheable request, 0 if the request is not one
+
+*/
+
+#define QCACHE_SLOTS 1024               //cached answers (power of two)
+#define QCACHE_MAX_REPLY 1048576        //larger answers are not kept
+#define QUERY_WORKERS 4                 //history answers served at once beside the accept loop
+
+uint query_workers = 0;                 //running query workers
+
+struct qcache
+{
+    char req[MIN_LEN];
+    uint64_t height;
+    float diff;
+    char* rep;
+    size_t len;
+};
+
+struct qcache qcache[QCACHE_SLOTS];
+
+uint queryCached(const char* req, char** out, size_t* olen)
+{
+    char cmd[32], arg[128];
+    memset(cmd, 0, sizeof(cmd));
+    memset(arg, 0, sizeof(arg));
+    if(sscanf(req, "%31s %127s", cmd, arg) != 2)
+        return 0;
+    if(strcmp(cmd, "balance") != 0 && strcmp(cmd, "all") != 0 && strcmp(cmd, "in") != 0 && strcmp(cmd, "out") != 0)
+        return 0;
+
+    char key[MIN_LEN];
+    snprintf(key, sizeof(key), "%s %s", cmd, arg);
+    struct qcache* c = &qcache[crc64(0, (unsigned char*)key, strlen(key)) & (QCACHE_SLOTS-1)];
+    const uint64_t height = getChainSize() / sizeof(struct trans);
+    const float diff = network_difficulty;
+
+    //Hit
+    *out = NULL;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex10);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    if(c->rep != NULL && c->height == height && c->diff == diff && strcmp(c->req, key) == 0)
+    {
+        *out = malloc(c->len+1);
+        if(*out != NULL)
+        {
+            memcpy(*out, c->rep, c->len+1);
+            *olen = c->len;
+        }
+    }
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex10);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    if(*out != NULL)
+        return 1;
+
+    //Miss
+    addr a;
+    memset(&a, 0, sizeof(addr));
+    size_t len = ECC_CURVE+1;
+    b58tobin(a.key, &len, arg, strlen(arg));
+
+    FILE* o = open_memstream(out, olen);
+    if(o == NULL)
+        return 0;
+    if(cmd[0] == 'b')
+        fprintf(o, "%lu\n", getBalanceLocal(&a));
+    else if(cmd[0] == 'a')
+        printAll(o, &a);
+    else if(cmd[0] == 'i')
+        printIns(o, &a);
+    else
+        printOuts(o, &a);
+    fclose(o);
+
+    //Keep it if nothing was appended meanwhile
+    if(*olen <= QCACHE_MAX_REPLY && getChainSize() / sizeof(struct trans) == height && network_difficulty == diff)
+    {
+        char* r = malloc(*olen+1);
+        if(r != NULL)
+        {
+            memcpy(r, *out, *olen+1);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex10);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+            free(c->rep);
+            strcpy(c->req, key);
+            c->height = height;
+            c->diff = diff;
+            c->rep = r;
+            c->len = *olen;
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex10);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        }
+    }
+
+    return 1;
+}
+
+//Answer a request line on a connection and close it
+static void queryReply(const int c, const char* req)
+{
+    char rep[4096];
+    char* out = NULL;
+    size_t len = 0;
+    if(queryCached(req, &out, &len) == 0 && queryWatched(req, &out, &len) == 0)
+    {
+        queryAnswer(req, rep, sizeof(rep));
+        len = strlen(rep);
+    }
+    const char* r = out != NULL ? out : rep;
+
+    size_t sent = 0;
+    while(sent < len)
+    {
+        const ssize_t w = send(c, r+sent, len-sent, MSG_NOSIGNAL);
+        if(w <= 0)
+            break;
+        sent += w;
+    }
+    free(out);
+    close(c);
+}
+
+struct query_job
+{
+    int c;
+    char req[MIN_LEN];
+};
+
+void *queryWorker(void *arg)
+{
+    struct query_job* j = arg;
+    queryReply(j->c, j->req);
+    free(j);
+    __atomic_sub_fetch(&query_workers, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+//History answers can be large, they are served off the accept loop while a worker is free
+static uint queryLarge(const char* req)
+{
+    char cmd[32];
+    memset(cmd, 0, sizeof(cmd));
+    if(sscanf(req, "%31s", cmd) != 1)
+        return 0;
+    return strcmp(cmd, "all") == 0 || strcmp(cmd, "in") == 0 || strcmp(cmd, "out") == 0 || strcmp(cmd, "watched") == 0;
+}
+
+void *queryThread(void *arg)
+{
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(s == -1)
     {
-        fwrite(peer_tcount, sizeof(uint), MAX_PEERS, f);
-        fclose(f);
+        printf("ERROR: Query Thread Socket Creation Failed.\n");
+        return 0;
     }
 
-    f = fopen(".vfc/peers2.mem", "w");
-    if(f)
+    struct sockaddr_un server;
+    memset(&server, 0, sizeof(server));
+    server.sun_family = AF_UNIX;
+    strncpy(server.sun_path, QUERY_SOCK, sizeof(server.sun_path)-1);
+
+    //Only one node can be running, anything left here is stale
+    unlink(QUERY_SOCK);
+    if(bind(s, (struct sockaddr*)&server, sizeof(server)) < 0 || listen(s, 64) < 0)
     {
-        fwrite(peer_timeouts, sizeof(time_t), MAX_PEERS, f);
-        fclose(f);
+        printf("ERROR: Query Thread failed to bind '%s'.\n", QUERY_SOCK);
+        close(s);
+        return 0;
     }
+    //Owner only, the socket changes the watch list
+    chmod(QUERY_SOCK, 0700);
 
-    f = fopen(".vfc/peers3.mem", "w");
-    if(f)
+    char req[MIN_LEN];
+    while(1)
     {
-        fwrite(peer_ua, 64, MAX_PEERS, f);
-        fclose(f);
-    }
+        int c = accept(s, NULL, NULL);
+        if(c == -1)
+            continue;
 
-    forceWrite(".vfc/netdiff.mem", &network_difficulty, sizeof(float));
-}
+        //Don't let a silent client hold up the socket
+        struct timeval tv;
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+        setsockopt(c, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof(tv));
 
-void loadmem()
-{
-    FILE* f = fopen(".vfc/peers.mem", "r");
-    if(f)
-    {
-        if(fread(peers, sizeof(uint), MAX_PEERS, f) != MAX_PEERS)
+        //Read the request line
+        size_t rl = 0;
+        while(rl < sizeof(req)-1)
         {
-            printf("Peers Memory Corrupted. Load Failed.\n");
-            err++;
+            const ssize_t r = recv(c, req+rl, sizeof(req)-1-rl, 0);
+            if(r <= 0)
+                break;
+            rl += r;
+            if(memchr(req, '\n', rl) != NULL)
+                break;
         }
-        fclose(f);
-    }
-    num_peers = countPeers();
+        req[rl] = 0x00;
 
-    f = fopen(".vfc/peers1.mem", "r");
-    if(f)
-    {
-        if(fread(peer_tcount, sizeof(uint), MAX_PEERS, f) != MAX_PEERS)
+        if(rl == 0)
         {
-            printf("Peers1 Memory Corrupted. Load Failed.\n");
-            err++;
+            close(c);
+            continue;
         }
-        fclose(f);
-    }
 
-    f = fopen(".vfc/peers2.mem", "r");
-    if(f)
-    {
-        if(fread(peer_timeouts, sizeof(uint), MAX_PEERS, f) != MAX_PEERS)
+        //Hand a history answer to a worker, with none free it's answered here
+        if(queryLarge(req) == 1 && __atomic_load_n(&query_workers, __ATOMIC_ACQUIRE) < QUERY_WORKERS)
         {
-            printf("Peers2 Memory Corrupted. Load Failed.\n");
-            err++;
+            struct query_job* j = malloc(sizeof(struct query_job));
+            if(j != NULL)
+            {
+                j->c = c;
+                memcpy(j->req, req, rl+1);
+                __atomic_add_fetch(&query_workers, 1, __ATOMIC_RELEASE);
+                pthread_t tid;
+                if(pthread_create(&tid, NULL, queryWorker, j) == 0)
+                {
+                    pthread_detach(tid);
+                    continue;
+                }
+                __atomic_sub_fetch(&query_workers, 1, __ATOMIC_RELEASE);
+                free(j);
+            }
         }
-        fclose(f);
-    }
 
-    f = fopen(".vfc/peers3.mem", "r");
-    if(f)
-    {
-        if(fread(peer_ua, 64, MAX_PEERS, f) != MAX_PEERS)
-        {
-            printf("Peers3 Memory Corrupted. Load Failed.\n");
-            err++;
-        }
-        fclose(f);
+        queryReply(c, req);
     }
 
-    setMasterNode();
+    return 0;
 }
 
-void sigintHandler(int sig_num) 
+uint queryNode(const char* req, char* rep, const size_t rlen)
 {
-    static int m_qe = 0;
-    
-    if(m_qe == 0)
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(s == -1)
+        return 0;
+
+    struct sockaddr_un server;
+    memset(&server, 0, sizeof(server));
+    server.sun_family = AF_UNIX;
+    strncpy(server.sun_path, QUERY_SOCK, sizeof(server.sun_path)-1);
+
+    if(connect(s, (struct sockaddr*)&server, sizeof(server)) < 0)
     {
-        printf("\nPlease Wait while we save the peers state...\n\n");
-        m_qe = 1;
+        close(s);
+        return 0;
+    }
 
-        savemem();
-        exit(0);
+    char line[MIN_LEN];
+    snprintf(line, sizeof(line), "%s\n", req);
+    if(send(s, line, strlen(line), MSG_NOSIGNAL) != (ssize_t)strlen(line))
+    {
+        close(s);
+        return 0;
+    }
+
+    size_t rl = 0;
+    while(rl < rlen-1)
+    {
+        const ssize_t r = recv(s, rep+rl, rlen-1-rl, 0);
+        if(r <= 0)
+            break;
+        rl += r;
     }
+    rep[rl] = 0x00;
+
+    close(s);
+    return rl > 0;
 }
 
-uint isNodeRunning()
+//Send a request to the running node and copy the reply to a stream, 0 if no node answered or the reply was empty
+uint queryNodeStream(const char* req, FILE* o)
 {
-    struct sockaddr_in server;
-
-    int s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
     if(s == -1)
-        return 1; //Might be running, we can't risk it, say it's running
+        return 0;
 
-    server.sin_family = AF_INET;
-    server.sin_addr.s_addr = INADDR_ANY;
-    server.sin_port = htons(31963);
-    
-    if(bind(s, (struct sockaddr*)&server, sizeof(server)) == 0)
+    struct sockaddr_un server;
+    memset(&server, 0, sizeof(server));
+    server.sun_family = AF_UNIX;
+    strncpy(server.sun_path, QUERY_SOCK, sizeof(server.sun_path)-1);
+
+    char line[MIN_LEN];
+    snprintf(line, sizeof(line), "%s\n", req);
+    if(connect(s, (struct sockaddr*)&server, sizeof(server)) < 0 || send(s, line, strlen(line), MSG_NOSIGNAL) != (ssize_t)strlen(line))
     {
         close(s);
-        return 0; //Bind success, we where not already running.
+        return 0;
+    }
+
+    //A node that closed without answering hasn't answered, the caller falls back
+    char buf[65536];
+    ssize_t r;
+    size_t rl = 0;
+    while((r = recv(s, buf, sizeof(buf), 0)) > 0)
+    {
+        fwrite(buf, 1, r, o);
+        rl += r;
     }
 
     close(s);
-    return 1; //Say it's running
+    return rl > 0;
 }
 
 void *generalThread(void *arg)
@@ -2811,13 +8779,37 @@ void *generalThread(void *arg)
     time_t nr = time(0);
     time_t pr = time(0);
     time_t aa = time(0);
+    time_t lc = time(0) + ledger_checkpoint;
     while(1)
     {
         sleep(3);
 
+        //Tell replica readers the node is still alive
+        replicaBeat();
+
         //Save memory state
         savemem();
 
+        //Snapshot the ledger for the CLI if it has moved on
+        if(ledger_checkpoint != 0 && time(0) > lc)
+        {
+            if(ledger_height != ledger_chk_height)
+            {
+                ledgerCheckpoint();
+                chainPrune();
+            }
+            lc = time(0) + ledger_checkpoint;
+        }
+
+        //Append the balance checkpoints the chain has passed
+        histUpdate();
+
+        //Seal the chain segments the chain has passed
+        segUpdate();
+
+        //Flush the event log
+        eventsSync();
+
         //Load new replay allow value
         forceRead(".vfc/rp.mem", &replay_allow, sizeof(uint)*MAX_PEERS);
 
@@ -2871,6 +8863,7 @@ void *generalThread(void *arg)
         {
             for(uint i = 0; i < MAX_PEERS; i++)
                 peer_ltcount[i] = 0;
+            memset(nonpeer_ltcount, 0, sizeof(nonpeer_ltcount));
             
             setMasterNode(); //Update master IPv4 from DNS
 
@@ -3074,11 +9067,38 @@ pthread_mutex_unlock(&mutex2);
         lip = ip[i];
         lipo = ipo[i];
         memcpy(&t, &tq[i], sizeof(struct trans));
+
+        //Released before the slot is freed, aQue() can reuse it after that
+        uint released = 0;
+        if(lreplay == 1)
+        {
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+            released = pendingRelease(i);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex7);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        }
         tq[i].amount = 0; //Signifies transaction as invalid / completed / processed (done)
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 if(single_threaded == 0)
 pthread_mutex_unlock(&mutex2);
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        if(released == 1)
+        {
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_lock(&mutex5);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+            coolRelease(t.from.key);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+if(single_threaded == 0)
+pthread_mutex_unlock(&mutex5);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+        }
         //Process the transaction
         const int r = process_trans(t.uid, &t.from, &t.to, t.amount, &t.owner);
 
@@ -3298,9 +9318,10 @@ void *networkThread(void *arg)
             ofs += sizeof(mval);
             memcpy(t.owner.key, ofs, ECC_CURVE*2);
             
-            //Transaction limiter
+            //Transaction limiter, senders that are not peers are limited by address and the local cli is not
             const int gp = getPeer(client.sin_addr.s_addr);
-            if(peer_ltcount[gp] < PEER_TRANSACTION_LIMIT_PER_MINUTE)
+            uint* ltcount = gp != -1 ? &peer_ltcount[gp] : client.sin_addr.s_addr == inet_addr("127.0.0.1") ? NULL : nonpeerCount(client.sin_addr.s_addr);
+            if(ltcount == NULL || *ltcount < PEER_TRANSACTION_LIMIT_PER_MINUTE)
             {
                 //Process Transaction (Threaded (using processThread()) not to jam up UDP relay)
                 const uint qrv = aQue(&t, client.sin_addr.s_addr, origin, 1);
@@ -3337,8 +9358,10 @@ void *networkThread(void *arg)
                     ofs += sizeof(mval);
                     memcpy(ofs, t.owner.key, ECC_CURVE*2);
 
-                    peer_tcount[gp]++; //race condition possible, however this is not a mission critical statistic
-                    peer_ltcount[gp]++; 
+                    if(gp != -1)
+                        peer_tcount[gp]++; //race condition possible, however this is not a mission critical statistic
+                    if(ltcount != NULL)
+                        (*ltcount)++;
 
                     if(qrv == 1) //Transaction Added to Que
                         triBroadcast(pc, trans_size, 3);
@@ -3347,6 +9370,10 @@ void *networkThread(void *arg)
                         peersBroadcast(pc, trans_size); //triBroadcast(pc, trans_size, 9);
                 }
             }
+            else
+            {
+                aQueRefuse(t.from.key, THROTTLE_PEER_LIMIT);
+            }
         }
 
         //peer is requesting a block replay
@@ -3366,18 +9393,9 @@ void *networkThread(void *arg)
             //Check this is the replay peer
             if(isPeer(client.sin_addr.s_addr))
             {
-                struct stat st;
-                stat(CHAIN_FILE, &st);
-
-                struct utsname ud;
-                uname(&ud);
-                
-                if(st.st_size > 0)
-                {
-                    char pc[MIN_LEN];
-                    snprintf(pc, sizeof(pc), "a%lu, %s, %u, %s, %.3f", st.st_size / sizeof(struct trans), version, num_processors, ud.machine, node_difficulty);
+                char pc[MIN_LEN];
+                if(userAgent(pc, sizeof(pc)) == 1)
                     csend(client.sin_addr.s_addr, pc, strlen(pc));
-                }
             }
         }
 
@@ -3390,8 +9408,7 @@ void *networkThread(void *arg)
             {
                 //printf("%s: %s\n", inet_ntoa(client.sin_addr), rb);
                 memset(peer_ua[p], 0, 64);
-                memcpy(&peer_ua[p], rb+1, read_size);
-                peer_ua[p][63] = 0x00;
+                memcpy(&peer_ua[p], rb+1, read_size-1 < 63 ? read_size-1 : 63);
             }
         }
 
@@ -3531,9 +9548,20 @@ void truncate_at_error(const char* file, const size_t num)
         {
             close(f);
 
+            //A pruned node's released records read back as zeros, the unsigned genesis record is never checked
+            const size_t height = len/sizeof(struct trans);
+            size_t start = num < height ? height-num : 0;
+            if(start < chainPruned())
+                start = chainPruned();
+            if(start < 1)
+                start = 1;
+
+            //Sealed segments are checked in parallel, the tail after them in order
+            start = segVerify(m, len, start);
+
             struct trans t;
             time_t st = time(0);
-            for(size_t i = sizeof(struct trans)*((len/sizeof(struct trans))-num); i < len; i += sizeof(struct trans))
+            for(size_t i = sizeof(struct trans)*start; i < len; i += sizeof(struct trans))
             {
                 memcpy(&t, m+i, sizeof(struct trans));
 
@@ -3543,18 +9571,8 @@ void truncate_at_error(const char* file, const size_t num)
                     st = time(0) + 9;
                 }
 
-                //Make original
-                struct trans to;
-                memset(&to, 0, sizeof(struct trans));
-                to.uid = t.uid;
-                memcpy(to.from.key, t.from.key, ECC_CURVE+1);
-                memcpy(to.to.key, t.to.key, ECC_CURVE+1);
-                to.amount = t.amount;
-
                 //Lets verify if this signature is valid
-                uint8_t thash[ECC_CURVE];
-                makHash(thash, &to);
-                if(ecdsa_verify(t.from.key, thash, t.owner.key) == 0)
+                if(recordSigned(&t) == 0)
                 {
                     //Alright this trans is invalid
 
@@ -3640,199 +9658,185 @@ void cleanChain()
     init_sites(433024253); //3,464 mb = 54,128,031 sites = 18,042,677 transactions before unsafe collision potential
     
     //Now clean the chain
-    int f = open(CHAIN_FILE, O_RDONLY);
-    if(f)
+    struct chain_view v;
+    if(store->view(&v) == 1)
     {
-        const size_t len = lseek(f, 0, SEEK_END);
+        const size_t len = v.len;
+        const unsigned char* m = v.m;
 
-        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-        if(m != MAP_FAILED)
+        struct trans t;
+        for(size_t i = sizeof(struct trans); i < len; i += sizeof(struct trans))
         {
-            close(f);
+            //Copy transaction
+            memcpy(&t, m+i, sizeof(struct trans));
 
-            struct trans t;
-            for(size_t i = sizeof(struct trans); i < len; i += sizeof(struct trans))
+            if(has_uid(t.uid) == 1) //Probable duplicate
             {
-                //Copy transaction
-                memcpy(&t, m+i, sizeof(struct trans));
-
-                if(has_uid(t.uid) == 1) //Probable duplicate
-                {
-                    char from[MIN_LEN];
-                    memset(from, 0, sizeof(from));
-                    size_t len = MIN_LEN;
-                    b58enc(from, &len, t.from.key, ECC_CURVE+1);
+                char from[MIN_LEN];
+                memset(from, 0, sizeof(from));
+                size_t len = MIN_LEN;
+                b58enc(from, &len, t.from.key, ECC_CURVE+1);
 
-                    char to[MIN_LEN];
-                    memset(to, 0, sizeof(from));
-                    size_t len2 = MIN_LEN;
-                    b58enc(to, &len2, t.to.key, ECC_CURVE+1);
+                char to[MIN_LEN];
+                memset(to, 0, sizeof(from));
+                size_t len2 = MIN_LEN;
+                b58enc(to, &len2, t.to.key, ECC_CURVE+1);
 
-                    char sig[MIN_LEN];
-                    memset(sig, 0, sizeof(sig));
-                    size_t len3 = MIN_LEN;
-                    b58enc(sig, &len3, t.owner.key, ECC_CURVE*2);
+                char sig[MIN_LEN];
+                memset(sig, 0, sizeof(sig));
+                size_t len3 = MIN_LEN;
+                b58enc(sig, &len3, t.owner.key, ECC_CURVE*2);
 
-                    setlocale(LC_NUMERIC, "");
-                    printf("pDUP: %lu, %s, %s, %s, %.3f\n", t.uid, from, to, sig, toDB(t.amount));
-                    continue;
-                }
+                setlocale(LC_NUMERIC, "");
+                printf("pDUP: %lu, %s, %s, %s, %.3f\n", t.uid, from, to, sig, toDB(t.amount));
+                continue;
+            }
 
-                //Ok let's write the transaction to chain
-                if(memcmp(t.from.key, t.to.key, ECC_CURVE+1) != 0) //Only log if the user was not sending VFC to themselves.
+            //Ok let's write the transaction to chain
+            if(memcmp(t.from.key, t.to.key, ECC_CURVE+1) != 0) //Only log if the user was not sending VFC to themselves.
+            {
+                FILE* f = fopen(".vfc/cblocks.dat", "a");
+                if(f)
                 {
-                    FILE* f = fopen(".vfc/cblocks.dat", "a");
-                    if(f)
-                    {
-                        fwrite(&t, sizeof(struct trans), 1, f);
-                        add_uid(t.uid, 172800); //48 hours
-                        fclose(f);
-                    }
+                    fwrite(&t, sizeof(struct trans), 1, f);
+                    add_uid(t.uid, 172800); //48 hours
+                    fclose(f);
                 }
             }
-
-            munmap(m, len);
         }
 
-        close(f);
+        store->release(&v);
     }
 }
 void cleanChainFull()
 {
-    int f = open(CHAIN_FILE, O_RDONLY);
-    if(f)
+    struct chain_view v;
+    if(store->view(&v) == 1)
     {
-        const size_t len = lseek(f, 0, SEEK_END);
+        const size_t len = v.len;
+        const unsigned char* m = v.m;
 
-        unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-        if(m != MAP_FAILED)
+        struct trans t;
+        for(size_t i = sizeof(struct trans); i < len; i += sizeof(struct trans))
         {
-            close(f);
+            //Copy transaction
+            memcpy(&t, m+i, sizeof(struct trans));
 
-            struct trans t;
-            for(size_t i = sizeof(struct trans); i < len; i += sizeof(struct trans))
+            // //Verify
+            // struct trans nt;
+            // memset(&nt, 0, sizeof(struct trans));
+            // nt.uid = t.uid;
+            // memcpy(nt.from.key, t.from.key, ECC_CURVE+1);
+            // memcpy(nt.to.key, t.to.key, ECC_CURVE+1);
+            // nt.amount = t.amount;
+            // uint8_t thash[ECC_CURVE];
+            // makHash(thash, &nt);
+            // if(ecdsa_verify(nt.from.key, thash, t.owner.key) == 0)
+            // {
+            //     printf("%lu: no verification\n", t.uid);
+            //     continue;
+            // }
+            // //
+            
+            //Check has balance and is unique
+            int hbr = 0;
+            int64_t rv = isSubGenesisAddress(t.from.key, 1);
+            int f = open(".vfc/cfblocks.dat", O_RDONLY);
+            if(f)
             {
-                //Copy transaction
-                memcpy(&t, m+i, sizeof(struct trans));
+                const size_t len = lseek(f, 0, SEEK_END);
 
-                // //Verify
-                // struct trans nt;
-                // memset(&nt, 0, sizeof(struct trans));
-                // nt.uid = t.uid;
-                // memcpy(nt.from.key, t.from.key, ECC_CURVE+1);
-                // memcpy(nt.to.key, t.to.key, ECC_CURVE+1);
-                // nt.amount = t.amount;
-                // uint8_t thash[ECC_CURVE];
-                // makHash(thash, &nt);
-                // if(ecdsa_verify(nt.from.key, thash, t.owner.key) == 0)
-                // {
-                //     printf("%lu: no verification\n", t.uid);
-                //     continue;
-                // }
-                // //
-                
-                //Check has balance and is unique
-                int hbr = 0;
-                int64_t rv = isSubGenesisAddress(t.from.key, 1);
-                f = open(".vfc/cfblocks.dat", O_RDONLY);
-                if(f)
+                unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
+                if(m != MAP_FAILED)
                 {
-                    const size_t len = lseek(f, 0, SEEK_END);
+                    close(f);
 
-                    unsigned char* m = mmap(NULL, len, PROT_READ, MAP_SHARED, f, 0);
-                    if(m != MAP_FAILED)
+                    struct trans tn;
+                    for(size_t i = 0; i < len; i += sizeof(struct trans))
                     {
-                        close(f);
-
-                        struct trans tn;
-                        for(size_t i = 0; i < len; i += sizeof(struct trans))
+                        if(tn.uid == t.uid)
                         {
-                            if(tn.uid == t.uid)
-                            {
-                                hbr = ERROR_UIDEXIST;
-                                munmap(m, len);
-                                break;
-                            }
-                            memcpy(&tn, m+i, sizeof(struct trans));
-
-                            if(memcmp(&tn.to.key, &t.from.key, ECC_CURVE+1) == 0)
-                                rv += tn.amount;
-                            else if(memcmp(&tn.from.key, &t.from.key, ECC_CURVE+1) == 0)
-                                rv -= tn.amount;
+                            hbr = ERROR_UIDEXIST;
+                            munmap(m, len);
+                            break;
                         }
+                        memcpy(&tn, m+i, sizeof(struct trans));
 
-                        munmap(m, len);
+                        if(memcmp(&tn.to.key, &t.from.key, ECC_CURVE+1) == 0)
+                            rv += tn.amount;
+                        else if(memcmp(&tn.from.key, &t.from.key, ECC_CURVE+1) == 0)
+                            rv -= tn.amount;
                     }
 
-                    close(f);
-                }
-                if(hbr != ERROR_UIDEXIST)
-                {
-                    if(rv >= t.amount)
-                        hbr = 1;
-                    else
-                        hbr = 0;
+                    munmap(m, len);
                 }
-                if(hbr == 0)
-                {
-                    char from[MIN_LEN];
-                    memset(from, 0, sizeof(from));
-                    size_t len = MIN_LEN;
-                    b58enc(from, &len, t.from.key, ECC_CURVE+1);
 
-                    char to[MIN_LEN];
-                    memset(to, 0, sizeof(from));
-                    size_t len2 = MIN_LEN;
-                    b58enc(to, &len2, t.to.key, ECC_CURVE+1);
+                close(f);
+            }
+            if(hbr != ERROR_UIDEXIST)
+            {
+                if(rv >= t.amount)
+                    hbr = 1;
+                else
+                    hbr = 0;
+            }
+            if(hbr == 0)
+            {
+                char from[MIN_LEN];
+                memset(from, 0, sizeof(from));
+                size_t len = MIN_LEN;
+                b58enc(from, &len, t.from.key, ECC_CURVE+1);
+
+                char to[MIN_LEN];
+                memset(to, 0, sizeof(from));
+                size_t len2 = MIN_LEN;
+                b58enc(to, &len2, t.to.key, ECC_CURVE+1);
 
-                    char sig[MIN_LEN];
-                    memset(sig, 0, sizeof(sig));
-                    size_t len3 = MIN_LEN;
-                    b58enc(sig, &len3, t.owner.key, ECC_CURVE*2);
+                char sig[MIN_LEN];
+                memset(sig, 0, sizeof(sig));
+                size_t len3 = MIN_LEN;
+                b58enc(sig, &len3, t.owner.key, ECC_CURVE*2);
 
-                    setlocale(LC_NUMERIC, "");
-                    printf("noBalance: %lu, %s, %s, %s, %.3f\n", t.uid, from, to, sig, toDB(t.amount));
-                    continue;
-                }
-                else if(hbr < 0)
-                {
-                    char from[MIN_LEN];
-                    memset(from, 0, sizeof(from));
-                    size_t len = MIN_LEN;
-                    b58enc(from, &len, t.from.key, ECC_CURVE+1);
+                setlocale(LC_NUMERIC, "");
+                printf("noBalance: %lu, %s, %s, %s, %.3f\n", t.uid, from, to, sig, toDB(t.amount));
+                continue;
+            }
+            else if(hbr < 0)
+            {
+                char from[MIN_LEN];
+                memset(from, 0, sizeof(from));
+                size_t len = MIN_LEN;
+                b58enc(from, &len, t.from.key, ECC_CURVE+1);
 
-                    char to[MIN_LEN];
-                    memset(to, 0, sizeof(from));
-                    size_t len2 = MIN_LEN;
-                    b58enc(to, &len2, t.to.key, ECC_CURVE+1);
+                char to[MIN_LEN];
+                memset(to, 0, sizeof(from));
+                size_t len2 = MIN_LEN;
+                b58enc(to, &len2, t.to.key, ECC_CURVE+1);
 
-                    char sig[MIN_LEN];
-                    memset(sig, 0, sizeof(sig));
-                    size_t len3 = MIN_LEN;
-                    b58enc(sig, &len3, t.owner.key, ECC_CURVE*2);
+                char sig[MIN_LEN];
+                memset(sig, 0, sizeof(sig));
+                size_t len3 = MIN_LEN;
+                b58enc(sig, &len3, t.owner.key, ECC_CURVE*2);
 
-                    setlocale(LC_NUMERIC, "");
-                    printf("uidExists: %lu, %s, %s, %s, %.3f\n", t.uid, from, to, sig, toDB(t.amount));
-                    continue;
-                }
-                //
+                setlocale(LC_NUMERIC, "");
+                printf("uidExists: %lu, %s, %s, %s, %.3f\n", t.uid, from, to, sig, toDB(t.amount));
+                continue;
+            }
+            //
 
-                //Ok let's write the transaction to chain
-                if(memcmp(t.from.key, t.to.key, ECC_CURVE+1) != 0) //Only log if the user was not sending VFC to themselves.
+            //Ok let's write the transaction to chain
+            if(memcmp(t.from.key, t.to.key, ECC_CURVE+1) != 0) //Only log if the user was not sending VFC to themselves.
+            {
+                FILE* f = fopen(".vfc/cfblocks.dat", "a");
+                if(f)
                 {
-                    FILE* f = fopen(".vfc/cfblocks.dat", "a");
-                    if(f)
-                    {
-                        fwrite(&t, sizeof(struct trans), 1, f);
-                        fclose(f);
-                    }
+                    fwrite(&t, sizeof(struct trans), 1, f);
+                    fclose(f);
                 }
             }
-
-            munmap(m, len);
         }
 
-        close(f);
+        store->release(&v);
     }
 }
 
@@ -4020,6 +10024,9 @@ int main(int argc , char *argv[])
 
  	    if(strstr(argv[1], "printtrans") != NULL)
         {
+            if(chainWhole() == 0)
+                exit(0);
+
             uint from;
             sscanf(argv[2], "%u", &from);
 
@@ -4028,47 +10035,130 @@ int main(int argc , char *argv[])
             printtrans(from, to);
             exit(0);
         }
+
+        //balance of an address as of a chain height
+        if(strcmp(argv[1], "balanceat") == 0)
+        {
+            forceRead(".vfc/netdiff.mem", &network_difficulty, sizeof(float));
+
+            addr from;
+            size_t len = ECC_CURVE+1;
+            b58tobin(from.key, &len, argv[2], strlen(argv[2]));
+            size_t height = 0;
+            sscanf(argv[3], "%zu", &height);
+
+            struct timespec s;
+            clock_gettime(CLOCK_MONOTONIC, &s);
+            int64_t rb;
+            if(balanceAt(&from, height, &rb) == 0)
+            {
+                printf("ERROR: height %zu is past the end of blocks.dat or its transactions have been pruned.\n", height);
+                exit(0);
+            }
+            rb += isSubGenesisAddress(from.key, 0);
+            struct timespec e;
+            clock_gettime(CLOCK_MONOTONIC, &e);
+
+            setlocale(LC_NUMERIC, "");
+            printf("The Balance for Address: %s\nAt Height: %'zu\nTime Taken %li Milliseconds.\n\nFinal Balance: %'.3f VFC\n\n", argv[2], height, (e.tv_sec - s.tv_sec) * 1000 + (e.tv_nsec - s.tv_nsec) / 1000000, toDB(rb < 0 ? 0 : rb));
+            exit(0);
+        }
+
+        //transactions that arrived between two epochs
+        if(strcmp(argv[1], "range") == 0)
+        {
+            uint from = 0, to = 0;
+            sscanf(argv[2], "%u", &from);
+            sscanf(argv[3], "%u", &to);
+
+            size_t first, last;
+            if(timeRange(from, to, &first, &last) == 1)
+                printtrans(first, last);
+            exit(0);
+        }
     }
 
     //Outgoings and Incomings
     if(argc == 3)
     {
-        //claim minted.priv
-        if(strcmp(argv[1], "claim") == 0)
+        //balances of many addresses in one pass; one address per line from a file or stdin '-'
+        if(strcmp(argv[1], "balances") == 0)
         {
             forceRead(".vfc/netdiff.mem", &network_difficulty, sizeof(float));
-            printf("Please Wait...");
-            fflush(stdout);
-            FILE* f = fopen(argv[2], "r");
-            if(f)
+
+            FILE* f = strcmp(argv[2], "-") == 0 ? stdin : fopen(argv[2], "r");
+            if(f == NULL)
+            {
+                printf("ERROR: Could not open %s\n", argv[2]);
+                exit(0);
+            }
+
+            size_t num = 0, cap = 256;
+            char (*b58)[MIN_LEN] = malloc(cap * MIN_LEN);
+            addr* list = malloc(cap * sizeof(addr));
+            char line[256];
+            while(b58 != NULL && list != NULL && fgets(line, sizeof(line), f) != NULL)
             {
-                char bpriv[256];
-                while(fgets(bpriv, 256, f) != NULL)
+                line[strcspn(line, " \r\n")] = 0x00;
+                if(line[0] == 0x00 || strlen(line) >= MIN_LEN)
+                    continue;
+
+                if(num == cap)
                 {
-                    for(uint i = 0; i < 256; i++)
-                    {
-                        if(bpriv[i] == ' ' || bpriv[i] == '\n')
-                        {
-                            bpriv[i] = 0x00;
-                            break;
-                        }
-                    }
+                    cap *= 2;
+                    b58 = realloc(b58, cap * MIN_LEN);
+                    list = realloc(list, cap * sizeof(addr));
+                    if(b58 == NULL || list == NULL)
+                        break;
+                }
 
-                    if(strlen(bpriv) < 16)
-                        continue;
+                memset(list[num].key, 0, ECC_CURVE+1);
+                size_t len = ECC_CURVE+1;
+                b58tobin(list[num].key, &len, line, strlen(line));
+                strcpy(b58[num], line);
+                num++;
+            }
+            if(f != stdin)
+                fclose(f);
+
+            uint64_t* bal = malloc((num+1) * sizeof(uint64_t));
+            if(b58 == NULL || list == NULL || bal == NULL)
+            {
+                printf("ERROR: Out of memory.\n");
+                exit(0);
+            }
+
+            struct timespec s;
+            clock_gettime(CLOCK_MONOTONIC, &s);
+            getBalancesLocal(list, bal, num);
+            struct timespec e;
+            clock_gettime(CLOCK_MONOTONIC, &e);
 
-                    //priv as bytes
-                    struct addr subg_priv;
-                    size_t len = ECC_CURVE;
-                    b58tobin(subg_priv.key, &len, bpriv, strlen(bpriv));
+            setlocale(LC_NUMERIC, "");
+            for(size_t j = 0; j < num; j++)
+                printf("The Balance for Address: %s\nFinal Balance: %'.3f VFC\n\n", b58[j], toDB(bal[j]));
+            printf("%'lu addresses, Time Taken %li Milliseconds.\n", num, (e.tv_sec - s.tv_sec) * 1000 + (e.tv_nsec - s.tv_nsec) / 1000000);
 
-                    //Gen Public Key
-                    struct addr subg_pub;
-                    ecc_get_pubkey(subg_pub.key, subg_priv.key);
+            free(b58);
+            free(list);
+            free(bal);
+            exit(0);
+        }
 
-                    //Get balance of pub key
-                    const double bal = toDB(getBalanceLocal(&subg_pub));
-                    //const double bal = toDB(isSubGenesisAddress(subg_pub.key, 0)); // little faster
+        //claim minted.priv
+        if(strcmp(argv[1], "claim") == 0)
+        {
+            forceRead(".vfc/netdiff.mem", &network_difficulty, sizeof(float));
+            printf("Please Wait...");
+            fflush(stdout);
+            size_t num = 0;
+            struct mkey* k = loadMintedKeys(argv[2], &num);
+            if(k)
+            {
+                for(size_t j = 0; j < num; j++)
+                {
+                    const char* bpriv = k[j].bpriv;
+                    const double bal = toDB(k[j].bal);
 
                     printf(".");
                     fflush(stdout);
@@ -4078,8 +10168,8 @@ int main(int argc , char *argv[])
                         //Public Key as Base58
                         char bpub[MIN_LEN];
                         memset(bpub, 0, sizeof(bpub));
-                        len = MIN_LEN;
-                        b58enc(bpub, &len, subg_pub.key, ECC_CURVE+1);
+                        size_t len = MIN_LEN;
+                        b58enc(bpub, &len, k[j].pub.key, ECC_CURVE+1);
 
                         //execute transaction
                         //printf("%s >%s : %.3f\n", bpub, myrewardkey, bal);
@@ -4095,7 +10185,7 @@ int main(int argc , char *argv[])
                         }
                     }
                 }
-                fclose(f);
+                free(k);
             }
             printf("\n");
             exit(0);
@@ -4167,6 +10257,14 @@ int main(int argc , char *argv[])
         //truncate blocks file at first invalid transaction found
         if(strcmp(argv[1], "trunc") == 0)
         {
+            if(isNodeRunning() == 1)
+            {
+                printf("The VFC node needs to be stopped before blocks.dat is truncated.\n\n");
+                exit(0);
+            }
+
+            if(chainWhole() == 0)
+                exit(0);
             truncate_at_error(CHAIN_FILE, atoi(argv[2]));
             exit(0);
         }
@@ -4198,11 +10296,10 @@ int main(int argc , char *argv[])
             time_t tt = time(0);
             while(1)
             {
-                struct stat st;
-                stat(CHAIN_FILE, &st);
-                if(st.st_size != ls)
+                const size_t size = getChainSize();
+                if(size != ls)
                 {
-                    ls = st.st_size;
+                    ls = size;
                     tc = 0;
                 }
 
@@ -4216,12 +10313,12 @@ int main(int argc , char *argv[])
 
                 forceRead(".vfc/rph.mem", &replay_height, sizeof(uint));
 
-                if(st.st_size > 0 && replay_height > 0)
+                if(size > 0 && replay_height > 0)
                 {
                     if(np == 0)
-                        printf("%.1f kb of %.1f kb downloaded press CTRL+C to Quit. Synchronizing only from the Master.\n", (double)st.st_size / 1000, (double)replay_height / 1000);
+                        printf("%.1f kb of %.1f kb downloaded press CTRL+C to Quit. Synchronizing only from the Master.\n", (double)size / 1000, (double)replay_height / 1000);
                     else
-                        printf("%.1f kb of %.1f kb downloaded press CTRL+C to Quit. Authorized %u Peers.\n", (double)st.st_size / 1000, (double)replay_height / 1000, np);
+                        printf("%.1f kb of %.1f kb downloaded press CTRL+C to Quit. Authorized %u Peers.\n", (double)size / 1000, (double)replay_height / 1000, np);
                 }
                 else
                 {
@@ -4294,12 +10391,128 @@ int main(int argc , char *argv[])
             exit(0);
         }
 
+        //Cross-check the supply accumulators against a full chain scan
+        if((strcmp(argv[1], "circulating") == 0 || strcmp(argv[1], "minted") == 0) && strcmp(argv[2], "--verify") == 0)
+        {
+            const uint circ = strcmp(argv[1], "circulating") == 0;
+            const uint64_t acc = circ == 1 ? getCirculatingSupplyLocal() : getMinedSupplyLocal();
+            const uint64_t scan = circ == 1 ? getCirculatingSupply() : getMinedSupply();
+            printf("Accumulated: %.3f\nScanned: %.3f\n%s\n", toDB(acc), toDB(scan), acc == scan ? "OK" : "MISMATCH");
+            exit(0);
+        }
+
         if(strcmp(argv[1], "findtrans") == 0)
         {
+            if(chainWhole() == 0)
+                exit(0);
             findTrans(strtoull(argv[2], NULL, 10));
             exit(0);
         }
 
+        //Confirmed balance with the transactions still queued on the node
+        if(strcmp(argv[1], "pending") == 0)
+        {
+            char req[MIN_LEN], rep[MIN_LEN];
+            snprintf(req, sizeof(req), "pending %s", argv[2]);
+            uint64_t confirmed, in, out, pb;
+            if(queryNode(req, rep, sizeof(rep)) == 0 || sscanf(rep, "%lu,%lu,%lu,%lu", &confirmed, &in, &out, &pb) != 4)
+            {
+                printf("The VFC node needs to be running to see pending transactions.\n\n");
+                exit(0);
+            }
+
+            setlocale(LC_NUMERIC, "");
+            printf("Confirmed Balance: %'.3f VFC\nQueued In: %'.3f VFC\nQueued Out: %'.3f VFC\n\nPending Balance: %'.3f VFC\n\n", toDB(confirmed), toDB(in), toDB(out), toDB(pb));
+            exit(0);
+        }
+
+        //sender cooldown & the reason its last transaction was refused
+        if(strcmp(argv[1], "throttle") == 0)
+        {
+            char req[MIN_LEN], rep[MIN_LEN], reason[MIN_LEN];
+            snprintf(req, sizeof(req), "cooldown %s", argv[2]);
+            uint remaining;
+            if(queryNode(req, rep, sizeof(rep)) == 0 || sscanf(rep, "%u,%255[^\n]", &remaining, reason) != 2)
+            {
+                printf("The VFC node needs to be running to see the sender cooldown.\n\n");
+                exit(0);
+            }
+
+            printf("Cooldown: %u Seconds\nLast Refusal: %s\n\n", remaining, reason);
+            exit(0);
+        }
+
+        //register a deposit address with the running node, or drop it
+        if(strcmp(argv[1], "watch") == 0 || strcmp(argv[1], "unwatch") == 0)
+        {
+            char req[MIN_LEN], rep[MIN_LEN];
+            snprintf(req, sizeof(req), "%s %s", argv[1], argv[2]);
+            uint changed;
+            if(queryNode(req, rep, sizeof(rep)) == 0 || sscanf(rep, "%u", &changed) != 1)
+            {
+                printf("The VFC node needs to be running to change the watch list, or edit %s/%s while it is stopped.\n\n", getHome(), WATCH_FILE);
+                exit(0);
+            }
+
+            if(argv[1][0] == 'w')
+                printf(changed == 1 ? "%s is now watched.\n\n" : "%s was already watched.\n\n", argv[2]);
+            else
+                printf(changed == 1 ? "%s is no longer watched.\n\n" : "%s was not watched.\n\n", argv[2]);
+            exit(0);
+        }
+
+        //the event log from an event number on
+        if(strcmp(argv[1], "events") == 0)
+        {
+            struct vfc_events l;
+            if(eventsOpen(&l, EVENTS_FILE) == 0)
+            {
+                printf("There is no event log, set `events 1` in %s/%s and restart the node.\n\n", getHome(), CONFIG_FILE);
+                exit(0);
+            }
+
+            const char* types[] = {"", "COMMIT", "BASE", "REWIND"};
+            const struct vfc_event* e;
+            for(uint64_t n = strtoull(argv[2], NULL, 10); (e = eventsAt(&l, n)) != NULL; n++)
+            {
+                char from[MIN_LEN], to[MIN_LEN];
+                memset(from, 0, sizeof(from));
+                memset(to, 0, sizeof(to));
+                if(e->type == EVENT_COMMIT)
+                {
+                    size_t len = MIN_LEN;
+                    b58enc(from, &len, e->from, ECC_CURVE+1);
+                    len = MIN_LEN;
+                    b58enc(to, &len, e->to, ECC_CURVE+1);
+                }
+                printf("%lu,%s,%lu,%u,%lu,%s,%s,%u,%li,%li\n", e->seq, e->type <= EVENT_REWIND ? types[e->type] : "", e->height, e->when, e->uid, from, to, e->amount, e->from_bal, e->to_bal);
+            }
+
+            eventsClose(&l);
+            exit(0);
+        }
+
+        //watched addresses with a transaction after a height
+        if(strcmp(argv[1], "watched") == 0)
+        {
+            char req[MIN_LEN];
+            snprintf(req, sizeof(req), "watched %s", argv[2]);
+            if(queryNodeStream(req, stdout) == 0)
+                printf("The VFC node needs to be running to list the watch list.\n\n");
+            exit(0);
+        }
+
+        //double spend attempts of one sender
+        if(strcmp(argv[1], "dumpbad") == 0)
+        {
+            addr a;
+            memset(&a, 0, sizeof(addr));
+            size_t len = ECC_CURVE+1;
+            b58tobin(a.key, &len, argv[2], strlen(argv[2]));
+            dumpbadAddr(&a);
+            exit(0);
+        }
+
         if(strcmp(argv[1], "addpeer") == 0)
         {
             loadmem();
@@ -4326,7 +10539,12 @@ int main(int argc , char *argv[])
             addr a;
             size_t len = ECC_CURVE+1;
             b58tobin(a.key, &len, argv[2], strlen(argv[2]));
-            printIns(&a);
+
+            //The running node answers repeat queries from its cache
+            char req[MIN_LEN];
+            snprintf(req, sizeof(req), "in %s", argv[2]);
+            if(queryNodeStream(req, stdout) == 0)
+                printIns(stdout, &a);
             exit(0);
         }
 
@@ -4335,7 +10553,12 @@ int main(int argc , char *argv[])
             addr a;
             size_t len = ECC_CURVE+1;
             b58tobin(a.key, &len, argv[2], strlen(argv[2]));
-            printOuts(&a);
+
+            //The running node answers repeat queries from its cache
+            char req[MIN_LEN];
+            snprintf(req, sizeof(req), "out %s", argv[2]);
+            if(queryNodeStream(req, stdout) == 0)
+                printOuts(stdout, &a);
             exit(0);
         }
 
@@ -4344,16 +10567,19 @@ int main(int argc , char *argv[])
             addr a;
             size_t len = ECC_CURVE+1;
             b58tobin(a.key, &len, argv[2], strlen(argv[2]));
-            printAll(&a);
+
+            //The running node answers repeat queries from its cache
+            char req[MIN_LEN];
+            snprintf(req, sizeof(req), "all %s", argv[2]);
+            if(queryNodeStream(req, stdout) == 0)
+                printAll(stdout, &a);
             exit(0);
         }
 
         //Dump top trans
         if(strcmp(argv[1], "dumptop") == 0)
         {
-            struct stat st;
-            stat(CHAIN_FILE, &st);
-            dumptrans((st.st_size / sizeof(struct trans)) - atoi(argv[2]));
+            dumptrans((getChainSize() / sizeof(struct trans)) - atoi(argv[2]));
             exit(0);
         }
 
@@ -4371,6 +10597,15 @@ int main(int argc , char *argv[])
             printf("vfc out <address public key>  - Gets sent transactions\n");
             printf("vfc in <address public key>   - Gets received transactions\n");
             printf("vfc all <address public key>  - Recv & Sent transactions\n");
+            printf("vfc pending <address public key> - Balance including queued transactions\n");
+            printf("vfc balanceat <address public key> <height> - Balance after the first <height> transactions\n");
+            printf("vfc balances <file path or ->        - Balances of many addresses, one per line\n");
+            printf("vfc throttle <optional address>       - Refused transactions by reason, or a sender's cooldown\n");
+            printf("vfc watch <address public key>        - Track an address in the running node, unwatch to drop it\n");
+            printf("vfc watched <optional height>         - Watched addresses active after a height: address,balance,last height,last epoch\n");
+            printf("vfc events <event number>             - Event log from an event on: seq,type,height,epoch,uid,from,to,amount,from balance,to balance\n");
+            printf("vfc writer                            - Durability level and commit latency of the running node\n");
+            printf("vfc segments                          - Sealed chain segments checked against blocks.dat: segment,first,records,min uid,max uid,state\n");
             printf("-----------------------------\n\n");
             printf("Send a transaction:\n");
             printf("vfc <sender public key> <reciever public key> <amount> <sender private key>\n\n");
@@ -4400,16 +10635,19 @@ int main(int argc , char *argv[])
             printf("vfc replaypeer <peer ip address> - Manually replay from specific peer\n");
             printf("vfc addpeer <peer ip address>    - Manually add a peer\n");
             printf("vfc printtrans 1000 1010         - Print transactions[start,end] on chain\n");
+            printf("vfc range <from epoch> <to epoch> - Print transactions that arrived in a time window\n");
             printf("vfc findtrans <transaction uid>  - Find a transaction by it's UID\n");
             printf("-------------------------------\n");
             printf("vfc dump                         - List all transactions on chain\n");
             printf("vfc dumptop <num trans>          - List top x transactions on chain\n");
             printf("vfc dumpbad                      - List all detected double spend attempts\n");
+            printf("vfc dumpbad <address public key> - List the double spend attempts of one sender\n");
             printf("vfc clearbad                     - Clear all detected double spend attempts\n");
             printf("-------------------------------\n\n");
             printf("Scan blocks.dat for invalid transactions and truncate at first detected:\nvfc trunc <offset from eof>\n\n");
             printf("[Fast] Scan blocks.dat for duplicate transactions and generates a cleaned output; cblocks.dat:\nvfc clean\n\n");
             printf("[Slow] Scan blocks.dat for invalid transactions and generates a cleaned output; cfblocks.dat:\nvfc cleanfull\n\n");
+            printf("Rebuild the transaction indexes from blocks.dat (node must be stopped):\nvfc reindex\n\n");
             printf("----------------\n");
             printf("vfc version      - Node version\n");
             printf("vfc agent        - Node user-agent\n");
@@ -4417,6 +10655,8 @@ int main(int argc , char *argv[])
             printf("vfc heigh        - Returns node [ blocks.dat size / num transactions ]\n");
             printf("vfc circulating  - Circulating supply\n");
             printf("vfc minted       - Minted supply\n");
+            printf("vfc circulating --verify - Check the supply counters with a full chain scan\n");
+            printf("vfc minted --verify      - Check the supply counters with a full chain scan\n");
             printf("vfc unclaimed    - Lists all unclaimed addresses from your minted.priv\n");
             printf("vfc claim        - Claims the contents of minted.priv to your rewards address\n");
             printf("----------------\n");
@@ -4432,12 +10672,9 @@ int main(int argc , char *argv[])
         if(strcmp(argv[1], "agent") == 0)
         {
             forceRead(".vfc/netdiff.mem", &node_difficulty, sizeof(float));
-            struct stat st;
-            stat(CHAIN_FILE, &st);
-            struct utsname ud;
-            uname(&ud);
-            if(st.st_size > 0)
-                printf("%lu, %s, %u, %s, %.3f\n", st.st_size / sizeof(struct trans), version, num_processors, ud.machine, node_difficulty);
+            char pc[MIN_LEN];
+            if(userAgent(pc, sizeof(pc)) == 1)
+                printf("%s\n", pc+1);
             exit(0);
         }
 
@@ -4487,14 +10724,14 @@ int main(int argc , char *argv[])
         //circulating supply
         if(strcmp(argv[1], "circulating") == 0)
         {
-            printf("%.3f\n", toDB(getCirculatingSupply()));
+            printf("%.3f\n", toDB(getCirculatingSupplyLocal()));
             exit(0);
         }
 
         //Mined VFC in circulation
         if(strcmp(argv[1], "minted") == 0)
         {
-            printf("%.3f\n", toDB(getMinedSupply()));
+            printf("%.3f\n", toDB(getMinedSupplyLocal()));
             exit(0);
         }
 
@@ -4515,42 +10752,18 @@ int main(int argc , char *argv[])
         {
             forceRead(".vfc/netdiff.mem", &network_difficulty, sizeof(float));
             fflush(stdout);
-            FILE* f = fopen(".vfc/minted.priv", "r");
-            if(f)
+            size_t num = 0;
+            struct mkey* k = loadMintedKeys(".vfc/minted.priv", &num);
+            if(k)
             {
-                char bpriv[256];
-                while(fgets(bpriv, 256, f) != NULL)
+                for(size_t j = 0; j < num; j++)
                 {
-                    for(uint i = 0; i < 256; i++)
-                    {
-                        if(bpriv[i] == ' ' || bpriv[i] == '\n')
-                        {
-                            bpriv[i] = 0x00;
-                            break;
-                        }
-                    }
-
-                    if(strlen(bpriv) < 16)
-                        continue;
-
-                    //priv as bytes
-                    struct addr subg_priv;
-                    size_t len = ECC_CURVE;
-                    b58tobin(subg_priv.key, &len, bpriv, strlen(bpriv));
-
-                    //Gen Public Key
-                    struct addr subg_pub;
-                    ecc_get_pubkey(subg_pub.key, subg_priv.key);
-
-                    //Get balance of pub key
-                    const double bal = toDB(getBalanceLocal(&subg_pub));
-
                     //Print private key & balance 
+                    const double bal = toDB(k[j].bal);
                     if(bal > 0)
-                        printf("%s (%.3f)\n", bpriv, bal);
-                    
+                        printf("%s (%.3f)\n", k[j].bpriv, bal);
                 }
-                fclose(f);
+                free(k);
             }
             exit(0);
         }
@@ -4561,36 +10774,14 @@ int main(int argc , char *argv[])
             forceRead(".vfc/netdiff.mem", &network_difficulty, sizeof(float));
             printf("Please Wait...");
             fflush(stdout);
-            FILE* f = fopen(".vfc/minted.priv", "r");
-            if(f)
+            size_t num = 0;
+            struct mkey* k = loadMintedKeys(".vfc/minted.priv", &num);
+            if(k)
             {
-                char bpriv[256];
-                while(fgets(bpriv, 256, f) != NULL)
+                for(size_t j = 0; j < num; j++)
                 {
-                    for(uint i = 0; i < 256; i++)
-                    {
-                        if(bpriv[i] == ' ' || bpriv[i] == '\n')
-                        {
-                            bpriv[i] = 0x00;
-                            break;
-                        }
-                    }
-
-                    if(strlen(bpriv) < 16)
-                        continue;
-
-                    //priv as bytes
-                    struct addr subg_priv;
-                    size_t len = ECC_CURVE;
-                    b58tobin(subg_priv.key, &len, bpriv, strlen(bpriv));
-
-                    //Gen Public Key
-                    struct addr subg_pub;
-                    ecc_get_pubkey(subg_pub.key, subg_priv.key);
-
-                    //Get balance of pub key
-                    const double bal = toDB(getBalanceLocal(&subg_pub));
-                    //const double bal = toDB(isSubGenesisAddress(subg_pub.key, 0)); // little faster
+                    const char* bpriv = k[j].bpriv;
+                    const double bal = toDB(k[j].bal);
 
                     printf(".");
                     fflush(stdout);
@@ -4600,8 +10791,8 @@ int main(int argc , char *argv[])
                         //Public Key as Base58
                         char bpub[MIN_LEN];
                         memset(bpub, 0, sizeof(bpub));
-                        len = MIN_LEN;
-                        b58enc(bpub, &len, subg_pub.key, ECC_CURVE+1);
+                        size_t len = MIN_LEN;
+                        b58enc(bpub, &len, k[j].pub.key, ECC_CURVE+1);
 
                         //execute transaction
                         //printf("%s >%s : %.3f\n", bpub, myrewardkey, bal);
@@ -4617,7 +10808,7 @@ int main(int argc , char *argv[])
                         }
                     }
                 }
-                fclose(f);
+                free(k);
             }
             printf("\n");
             exit(0);
@@ -4653,10 +10844,9 @@ int main(int argc , char *argv[])
         //Block height / total blocks / size
         if(strcmp(argv[1], "heigh") == 0)
         {
-            struct stat st;
-            stat(CHAIN_FILE, &st);
-            if(st.st_size > 0)
-                printf("%1.f kb / %lu Transactions\n", (double)st.st_size / 1000, st.st_size / sizeof(struct trans));
+            const size_t size = getChainSize();
+            if(size > 0)
+                printf("%1.f kb / %lu Transactions\n", (double)size / 1000, size / sizeof(struct trans));
             exit(0);
         }
 
@@ -4711,11 +10901,10 @@ int main(int argc , char *argv[])
             time_t tt = time(0);
             while(1)
             {
-                struct stat st;
-                stat(CHAIN_FILE, &st);
-                if(st.st_size != ls)
+                const size_t size = getChainSize();
+                if(size != ls)
                 {
-                    ls = st.st_size;
+                    ls = size;
                     tc = 0;
                 }
 
@@ -4729,12 +10918,12 @@ int main(int argc , char *argv[])
 
                 forceRead(".vfc/rph.mem", &replay_height, sizeof(uint));
 
-                if(st.st_size > 0 && replay_height > 0)
+                if(size > 0 && replay_height > 0)
                 {
                     if(replay_allow[0] == 0)
-                        printf("%.1f kb of %.1f kb downloaded press CTRL+C to Quit. Synchronizing only from the Master.\n", (double)st.st_size / 1000, (double)replay_height / 1000);
+                        printf("%.1f kb of %.1f kb downloaded press CTRL+C to Quit. Synchronizing only from the Master.\n", (double)size / 1000, (double)replay_height / 1000);
                     else
-                        printf("%.1f kb of %.1f kb downloaded press CTRL+C to Quit.\n", (double)st.st_size / 1000, (double)replay_height / 1000);
+                        printf("%.1f kb of %.1f kb downloaded press CTRL+C to Quit.\n", (double)size / 1000, (double)replay_height / 1000);
                 }
                 else
                 {
@@ -4751,6 +10940,12 @@ int main(int argc , char *argv[])
         //master_resync
         if(strcmp(argv[1], "master_resync") == 0 || strcmp(argv[1], "cdn_resync") == 0)
         {
+            if(isNodeRunning() == 1)
+            {
+                printf("The VFC node needs to be stopped before blocks.dat is replaced.\n\n");
+                exit(0);
+            }
+
             remove("blocks.dat");
 
             printf("Please select a mirror: 1 or 2: ");
@@ -4774,6 +10969,12 @@ int main(int argc , char *argv[])
         //resync
         if(strcmp(argv[1], "reset_chain") == 0)
         {
+            if(isNodeRunning() == 1)
+            {
+                printf("The VFC node needs to be stopped before the chain is reset.\n\n");
+                exit(0);
+            }
+
             makGenesis(); //Erases chain and resets it for a full resync
             loadmem();
             printf("Chain Reset.\n\n");
@@ -4806,6 +11007,8 @@ int main(int argc , char *argv[])
         //Dump all trans
         if(strcmp(argv[1], "dump") == 0)
         {
+            if(chainWhole() == 0)
+                exit(0);
             dumptrans(0);
             exit(0);
         }
@@ -4821,12 +11024,52 @@ int main(int argc , char *argv[])
         if(strcmp(argv[1], "clearbad") == 0)
         {
             remove(BADCHAIN_FILE);
+            remove(BADIDX_FILE);
+            exit(0);
+        }
+
+        //Rebuild the indexes from the chain
+        if(strcmp(argv[1], "reindex") == 0)
+        {
+            if(isNodeRunning() == 1)
+            {
+                printf("The VFC node needs to be stopped before the indexes are rebuilt.\n\n");
+                exit(0);
+            }
+
+            if(chainPruned() != 0)
+            {
+                printf("blocks.dat has been pruned, the indexes can not be rebuilt from it.\n\n");
+                exit(0);
+            }
+
+            if(uidxBuild(0) == 1 && uidxOpen(0) == 1)
+            {
+                setlocale(LC_NUMERIC, "");
+                printf("UID Index: %'lu transactions.\n", uidx->height);
+                uidxClose();
+            }
+
+            if(aidxBuild() == 1 && aidxOpen(0) == 1)
+            {
+                setlocale(LC_NUMERIC, "");
+                printf("Address Index: %'lu addresses, %'lu transactions.\n", aidx->num, aidx->height);
+                aidxClose();
+            }
             exit(0);
         }
 
         //Create a cleaned chain
         if(strcmp(argv[1], "clean") == 0)
         {
+            if(isNodeRunning() == 1)
+            {
+                printf("The VFC node needs to be stopped before a cleaned chain is created.\n\n");
+                exit(0);
+            }
+
+            if(chainWhole() == 0)
+                exit(0);
             newClean();
             cleanChain();
             exit(0);
@@ -4835,6 +11078,14 @@ int main(int argc , char *argv[])
         //Create a cleaned chain
         if(strcmp(argv[1], "cleanfull") == 0)
         {
+            if(isNodeRunning() == 1)
+            {
+                printf("The VFC node needs to be stopped before a cleaned chain is created.\n\n");
+                exit(0);
+            }
+
+            if(chainWhole() == 0)
+                exit(0);
             newClean();
             cleanChainFull();
             exit(0);
@@ -4856,6 +11107,70 @@ int main(int argc , char *argv[])
             exit(0);
         }
 
+        //every watched address
+        if(strcmp(argv[1], "watched") == 0)
+        {
+            if(queryNodeStream("watched", stdout) == 0)
+                printf("The VFC node needs to be running to list the watch list.\n\n");
+            exit(0);
+        }
+
+        //refused transactions by reason
+        if(strcmp(argv[1], "throttle") == 0)
+        {
+            char rep[4096];
+            if(queryNode("throttle", rep, sizeof(rep)) == 0 || strchr(rep, ',') == NULL)
+            {
+                printf("The VFC node needs to be running to see the refused transactions.\n\n");
+                exit(0);
+            }
+
+            setlocale(LC_NUMERIC, "");
+            char* l = strtok(rep, "\n");
+            while(l != NULL)
+            {
+                char* c = strrchr(l, ',');
+                if(c != NULL)
+                {
+                    *c = 0x00;
+                    printf("%s: %'lu\n", l, strtoul(c+1, NULL, 10));
+                }
+                l = strtok(NULL, "\n");
+            }
+            printf("\n");
+            exit(0);
+        }
+
+        //sealed chain segments checked against blocks.dat
+        if(strcmp(argv[1], "segments") == 0)
+        {
+            segList();
+            exit(0);
+        }
+
+        //durability level and commit latency of the append writer
+        if(strcmp(argv[1], "writer") == 0)
+        {
+            char rep[256];
+            uint level, interval;
+            unsigned long records, batches, syncs;
+            double cavg, cmax, savg, smax;
+            if(queryNode("writer", rep, sizeof(rep)) == 0 || sscanf(rep, "%u,%u,%lu,%lu,%lf,%lf,%lu,%lf,%lf", &level, &interval, &records, &batches, &cavg, &cmax, &syncs, &savg, &smax) != 9)
+            {
+                printf("The VFC node needs to be running to see the append writer.\n\n");
+                exit(0);
+            }
+
+            const char* levels[] = {"page cache", "periodic sync", "sync per batch"};
+            setlocale(LC_NUMERIC, "");
+            printf("Durability: %u (%s", level, levels[level > 2 ? 2 : level]);
+            if(level == 1)
+                printf(" every %'u ms", interval);
+            printf(")\nCommits: %'lu in %'lu writes\nCommit latency: %'.1f us avg, %'.1f us max\n", records, batches, cavg, cmax);
+            printf("Syncs: %'lu, %'.1f us avg, %'.1f us max\n\n", syncs, savg, smax);
+            exit(0);
+        }
+
         //Force add a peer
         if(strcmp(argv[1], "addpeer") == 0)
         {
@@ -4877,7 +11192,7 @@ int main(int argc , char *argv[])
             loadmem();
             printf("\nTip; If you are running a full-node then consider hosting a website on port 80 where you can declare a little about your operation and a VFC address people can use to donate to you on. Thus you should be able to visit any of these IP addresses in a web-browser and find out a little about each node or obtain a VFC Address to donate to the node operator on.\n\n");
             printf("Total Peers: %u\n\n", num_peers);
-            printf("IP Address / Number of Transactions Relayed / Seconds since last trans or ping / user-agent [blockheight/version/cpu cores/machine/difficulty] \n");
+            printf("IP Address / Number of Transactions Relayed / Seconds since last trans or ping / user-agent [blockheight/version/cpu cores/machine/digest/difficulty] \n");
             uint ac = 0;
             for(uint i = 0; i < num_peers; ++i)
             {
@@ -4935,10 +11250,25 @@ int main(int argc , char *argv[])
         size_t len = ECC_CURVE+1;
         b58tobin(from.key, &len, argv[1], strlen(argv[1]));
 
-        //Local
+        //Read the running node's ledger replica, or ask the node, it answers repeat queries from its cache
         struct timespec s;
         clock_gettime(CLOCK_MONOTONIC, &s);
-        uint64_t bal = getBalanceLocal(&from);
+        char req[MIN_LEN], rep[MIN_LEN];
+        snprintf(req, sizeof(req), "balance %s", argv[1]);
+        uint64_t bal = 0;
+        int64_t rb;
+        uint64_t rh;
+        uint scanned = 0;
+        if(replicaLookup(&from, &rb, &rh) == 1)
+        {
+            rb += isSubGenesisAddress(from.key, 0);
+            bal = rb < 0 ? 0 : rb;
+        }
+        else if(queryNode(req, rep, sizeof(rep)) == 0 || sscanf(rep, "%lu", &bal) != 1)
+        {
+            bal = getBalanceLocal(&from);
+            scanned = 1;
+        }
         struct timespec e;
         clock_gettime(CLOCK_MONOTONIC, &e);
         time_t td = (e.tv_nsec - s.tv_nsec);
@@ -4948,6 +11278,10 @@ int main(int argc , char *argv[])
         //Result
         setlocale(LC_NUMERIC, "");
         printf("The Balance for Address: %s\nTime Taken %li Milliseconds (%li ns).\n\nFinal Balance: %'.3f VFC\n\n", argv[1], td, (e.tv_nsec - s.tv_nsec), toDB(bal));
+
+        //The scan re-enforces the address's transactions over the network, an answer from the node or replica does it here
+        if(scanned == 0)
+            reenforceAddress(&from);
         exit(0);
     }
 
@@ -5247,6 +11581,38 @@ while(1)
     printf("Quick Scan: Checking blocks.dat for invalid transactions...\n");
     truncate_at_error(CHAIN_FILE, 9333);
 
+    //The node owns the chain height from here on
+    heightInit();
+
+    //The event log has to be lined up with the chain before the ledger build logs the records after it
+    eventsInit();
+
+    //Build the ledger so balances don't require a scan of blocks.dat, a pruned chain starts from its snapshot
+    printf("Loading the address ledger...\n");
+    chain_pruned = chainPruned();
+    if(chain_pruned != 0 && store == &flat_store)
+    {
+        printf("ERROR: blocks.dat has been pruned, it needs the indexed storage (storage 1).\n");
+        exit(0);
+    }
+    if(prune_keep != 0 && ledger_checkpoint == 0)
+        ledger_checkpoint = 600;
+    if(chain_pruned == 0)
+        ledgerInit();
+    else if(ledgerLoad() == 0)
+        exit(0);
+    printf("Ledger: %'lu addresses from %'lu transactions.\n", ledger.num, ledger_height);
+    replicaInit();
+    if(ledger_checkpoint != 0)
+        ledgerCheckpoint();
+    printf("Storage: %s\n", store->name);
+    store->open();
+    timeInit();
+    histInit();
+    segInit();
+    chainPrune();
+    watchInit();
+
     //Hijack CTRL+C
     signal(SIGINT, sigintHandler);
 
@@ -5268,6 +11634,18 @@ while(1)
     if(single_threaded == 1)
         nthreads = 1;
     
+    //Launch the Append Writer thread, commits are written by it from here on
+    writerInit();
+    if(writer_fd != -1)
+    {
+        pthread_t tid5;
+        if(pthread_create(&tid5, NULL, writerThread, NULL) != 0)
+        {
+            close(writer_fd);
+            writer_fd = -1;
+        }
+    }
+
     //Launch the Transaction Processing threads
     for(int i = 0; i < nthreads; i++)
     {
@@ -5288,6 +11666,14 @@ while(1)
     pthread_t tid2;
     pthread_create(&tid2, NULL, generalThread, NULL);
 
+    //Launch the Local Query thread
+    pthread_t tid3;
+    pthread_create(&tid3, NULL, queryThread, NULL);
+
+    //Launch the Double Spend Journal thread
+    pthread_t tid4;
+    pthread_create(&tid4, NULL, badThread, NULL);
+
 
     //Loop, until sigterm
     struct sockaddr_in server;
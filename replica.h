@@ -0,0 +1,186 @@
+/*
+    VFC Ledger Replica
+
+    The running node publishes its ledger to .vfc/ledger.shm, a read-only
+    shared mapping of every address balance along with the chain height and
+    the supply accumulators. This header is all a reader needs, a gateway can
+    include it and answer balance lookups in microseconds without spawning
+    `vfc` or touching blocks.dat.
+
+    Writes are guarded by a sequence lock, seq is odd while the node is
+    updating the table and a reader retries until it copied a value with the
+    same even seq on both sides. The replica is only valid while the node
+    that owns it is alive, and a retired mapping (the table was grown or
+    rebuilt) has to be reopened. The node refreshes a heartbeat every few
+    seconds, a replica whose heartbeat is older than REPLICA_STALE seconds
+    is not trusted even if its pid has since been reused by another process.
+
+    Balances exclude the subG value of minted addresses, it depends on the
+    network difficulty and is added by `vfc <address>`.
+
+    replicaOpen() - Map the replica read-only
+    replicaBalance() - Chain balance of an address and the height it was read at
+    replicaLive() - Is the mapping still maintained by a running node
+    replicaClose() - Unmap the replica
+
+    Example:
+        struct vfc_replica r;
+        int64_t bal;
+        uint64_t height;
+        if(replicaOpen(&r, "/home/vfc/.vfc/ledger.shm") == 1 && replicaBalance(&r, key, &bal, &height) == 1)
+            ...
+        replicaClose(&r);
+*/
+
+#ifndef REPLICA_H
+#define REPLICA_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ecc.h"
+
+#define REPLICA_MAGIC 0x3230706572636676 //"vfcrep02"
+#define REPLICA_KEY (ECC_CURVE+1)
+#define REPLICA_STALE 60    //seconds without a heartbeat before the replica is abandoned
+
+struct replica_head
+{
+    uint64_t magic;     //zeroed when the mapping is retired
+    uint64_t pid;       //node maintaining the replica, zero once it stopped
+    uint64_t seq;       //odd while an update is in progress
+    uint64_t cap;       //slots, a power of two
+    uint64_t num;       //used slots
+    uint64_t salt;
+    uint64_t height;    //chain records applied
+    uint64_t minted;    //supply accumulators, see getMinedSupply()
+    uint64_t circ;
+    uint64_t beat;      //epoch the node last refreshed the replica at
+};
+
+struct replica_slot
+{
+    uint8_t key[REPLICA_KEY];
+    uint8_t used;
+    uint8_t pad[6];
+    int64_t bal;
+};
+
+struct vfc_replica
+{
+    struct replica_head* h;
+    size_t len;
+};
+
+static inline uint64_t replicaHash(const uint64_t salt, const uint8_t* key)
+{
+    uint64_t h = salt, w;
+    for(unsigned i = 1; i < REPLICA_KEY; i += sizeof(uint64_t))
+    {
+        memcpy(&w, key+i, sizeof(uint64_t));
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 32;
+    }
+    return h ^ key[0];
+}
+
+static inline int replicaLive(const struct vfc_replica* r)
+{
+    if(r->h == NULL || __atomic_load_n(&r->h->magic, __ATOMIC_ACQUIRE) != REPLICA_MAGIC)
+        return 0;
+    const pid_t pid = __atomic_load_n(&r->h->pid, __ATOMIC_ACQUIRE);
+    const uint64_t beat = __atomic_load_n(&r->h->beat, __ATOMIC_ACQUIRE);
+    const uint64_t now = time(0);
+    if(pid <= 0 || beat + REPLICA_STALE < now)
+        return 0;
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+static inline void replicaClose(struct vfc_replica* r)
+{
+    if(r->h != NULL)
+        munmap(r->h, r->len);
+    r->h = NULL;
+    r->len = 0;
+}
+
+static inline int replicaOpen(struct vfc_replica* r, const char* path)
+{
+    r->h = NULL;
+    r->len = 0;
+
+    const int f = open(path, O_RDONLY);
+    if(f < 0)
+        return 0;
+
+    struct stat st;
+    if(fstat(f, &st) != 0 || st.st_size < (off_t)sizeof(struct replica_head))
+    {
+        close(f);
+        return 0;
+    }
+
+    struct replica_head* h = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, f, 0);
+    close(f);
+    if(h == MAP_FAILED)
+        return 0;
+
+    r->h = h;
+    r->len = st.st_size;
+    if(h->cap == 0 || (h->cap & (h->cap-1)) != 0 || r->len != sizeof(struct replica_head) + h->cap*sizeof(struct replica_slot) || replicaLive(r) == 0)
+    {
+        replicaClose(r);
+        return 0;
+    }
+
+    return 1;
+}
+
+//1 with the balance (zero for an unknown address), 0 when the replica has to be reopened
+static inline int replicaBalance(const struct vfc_replica* r, const uint8_t* key, int64_t* bal, uint64_t* height)
+{
+    const struct replica_slot* s = (const struct replica_slot*)(r->h+1);
+    const uint64_t mask = r->h->cap - 1;
+
+    for(unsigned tries = 0; tries < 1000000; tries++)
+    {
+        if(replicaLive(r) == 0)
+            return 0;
+
+        const uint64_t s1 = __atomic_load_n(&r->h->seq, __ATOMIC_ACQUIRE);
+        if((s1 & 1) != 0)
+            continue;
+
+        int64_t b = 0;
+        uint64_t i = replicaHash(r->h->salt, key) & mask;
+        for(uint64_t n = 0; n <= mask; n++, i = (i+1) & mask)
+        {
+            if(s[i].used == 0)
+                break;
+            if(memcmp(s[i].key, key, REPLICA_KEY) == 0)
+            {
+                b = s[i].bal;
+                break;
+            }
+        }
+        const uint64_t hh = r->h->height;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&r->h->seq, __ATOMIC_RELAXED) == s1)
+        {
+            *bal = b;
+            *height = hh;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+#endif